@@ -66,6 +66,8 @@ typedef struct {
 #define AP_EXPR_FLAG_RESTRICTED            4
 /** Expression evaluates to a string, not to a bool */
 #define AP_EXPR_FLAG_STRING_RESULT         8
+/** Don't evaluate the constant parts of the expression at parse time */
+#define AP_EXPR_FLAG_NO_FOLD              16
 
 
 /**
@@ -717,6 +717,16 @@
  * 20211221.12 (2.5.1-dev) Add cmd_parms->regex
  * 20211221.13 (2.5.1-dev) Add hook token_checker to check for authorization other
  *                         than username / password. Add autht_provider structure.
+ * 20211221.14 (2.5.1-dev) Add ap_escape_json()
+ * 20211221.15 (2.5.1-dev) Add AP_REG_NO_JIT and ap_regcomp_jit_stats()
+ * 20211221.16 (2.5.1-dev) Add phase_timing to core_server_config,
+ *                         phase_times to core_request_config,
+ *                         ap_request_phase_lookup(), ap_request_phase_time()
+ * 20211221.17 (2.5.1-dev) Add ap_extended_status_lite
+ * 20211221.18 (2.5.1-dev) Add ap_vhost_find_given_conn()
+ * 20211221.19 (2.5.1-dev) Add ap_merge_per_dir_configs_shared()
+ * 20211221.20 (2.5.1-dev) Add ap_set_merge_cache_size()
+ * 20211221.21 (2.5.1-dev) Add AP_EXPR_FLAG_NO_FOLD
  */
 
 #define MODULE_MAGIC_COOKIE 0x41503235UL /* "AP25" */
@@ -724,7 +734,7 @@
 #ifndef MODULE_MAGIC_NUMBER_MAJOR
 #define MODULE_MAGIC_NUMBER_MAJOR 20211221
 #endif
-#define MODULE_MAGIC_NUMBER_MINOR 13             /* 0...n */
+#define MODULE_MAGIC_NUMBER_MINOR 21             /* 0...n */
 
 /**
  * Determine if the server's current MODULE_MAGIC_NUMBER is at least a
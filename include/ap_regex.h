@@ -89,6 +89,8 @@ extern "C" {
 
 #define AP_REG_NO_DEFAULT 0x400 /**< Don't implicitely add AP_REG_DEFAULT options */
 
+#define AP_REG_NO_JIT 0x800 /**< Don't compile the pattern to native code */
+
 #define AP_REG_MATCH "MATCH_" /**< suggested prefix for ap_regname */
 
 #define AP_REG_DEFAULT (AP_REG_DOTALL|AP_REG_DOLLAR_ENDONLY)
@@ -151,6 +153,17 @@ AP_DECLARE(void) ap_regcomp_set_default_cflags(int cflags);
  */
 AP_DECLARE(int) ap_regcomp_default_cflag_by_name(const char *name);
 
+/**
+ * Get the number of regular expressions compiled, and how many of them
+ * were compiled to native code by the PCRE2 JIT.
+ * @param compiled Set to the number of regexes compiled (may be NULL)
+ * @param jitted Set to the number of JIT compiled regexes (may be NULL)
+ * @param reset Whether to reset both counters after reading them
+ * @return Non-zero if the PCRE library in use supports JIT compilation
+ */
+AP_DECLARE(int) ap_regcomp_jit_stats(apr_uint32_t *compiled,
+                                     apr_uint32_t *jitted, int reset);
+
 /**
  * Compile a regular expression.
  * @param preg Returned compiled regex
@@ -1136,6 +1136,33 @@ AP_CORE_DECLARE(ap_conf_vector_t*) ap_merge_per_dir_configs(apr_pool_t *p,
                                            ap_conf_vector_t *base,
                                            ap_conf_vector_t *new_conf);
 
+/**
+ * Run all of the modules merge per dir config functions, like
+ * ap_merge_per_dir_configs(), but reuse the result for all requests
+ * of the process that merge the same pair of config vectors.
+ * @param p The pool to merge in when no shared result can be kept
+ * @param base The base directory config structure
+ * @param new_conf The new directory config structure
+ * @param shared Set to 1 when the result is shared, 0 when it was
+ *        allocated from p
+ * @return The merged config vector
+ * @note Both base and new_conf must live as long as the configuration,
+ *       e.g. the config vectors of sections, of the server or the
+ *       shared results of this function.
+ */
+AP_CORE_DECLARE(ap_conf_vector_t*) ap_merge_per_dir_configs_shared(apr_pool_t *p,
+                                           ap_conf_vector_t *base,
+                                           ap_conf_vector_t *new_conf,
+                                           int *shared);
+
+/**
+ * Set the number of merges kept by ap_merge_per_dir_configs_shared()
+ * @param entries The maximum number of entries, 0 to disable the cache
+ * @note Takes effect at the next post_config, the default is restored
+ *       at each pre_config.
+ */
+AP_CORE_DECLARE(void) ap_set_merge_cache_size(int entries);
+
 /**
  * Allocate new ap_logconf and make (deep) copy of old ap_logconf
  * @param p The pool to alloc from
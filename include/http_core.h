@@ -440,6 +440,11 @@ typedef struct {
     /** Should addition of charset= be suppressed for this request?
      */
     int suppress_charset;
+
+    /** Time spent in each request processing phase (indexed by
+     *  AP_REQUEST_PHASE_*), NULL unless RequestPhaseTiming is enabled
+     */
+    apr_interval_time_t *phase_times;
 } core_request_config;
 
 /* Standard entries that are guaranteed to be accessible via
@@ -770,6 +775,7 @@ typedef struct {
     apr_int32_t  flush_max_pipelined;
     unsigned int strict_host_check;
     unsigned int merge_slashes;
+    unsigned int phase_timing;
 } core_server_config;
 
 /* for AddOutputFiltersByType in core.c */
@@ -65,6 +65,48 @@ extern "C" {
  */
 AP_DECLARE(int) ap_process_request_internal(request_rec *r);
 
+/**
+ * @defgroup AP_REQUEST_PHASE Request processing phases
+ * The phases timed by ap_process_request_internal() and ap_invoke_handler()
+ * when RequestPhaseTiming is enabled.
+ * @{
+ */
+/** pre_translate_name, the location walk and translate_name */
+#define AP_REQUEST_PHASE_TRANSLATE 0
+/** map_to_storage, the location rewalk and post_perdir_config */
+#define AP_REQUEST_PHASE_STORAGE   1
+/** header_parser (main requests only) */
+#define AP_REQUEST_PHASE_HEADERS   2
+/** token, access, authentication and authorization checks */
+#define AP_REQUEST_PHASE_AUTH      3
+/** type_checker */
+#define AP_REQUEST_PHASE_TYPE      4
+/** fixups */
+#define AP_REQUEST_PHASE_FIXUPS    5
+/** the content handler */
+#define AP_REQUEST_PHASE_HANDLER   6
+/** number of phases */
+#define AP_REQUEST_PHASE_MAX       7
+/** @} */
+
+/**
+ * Look up a request processing phase by name ("translate", "storage",
+ * "headers", "auth", "type", "fixups" or "handler", case insensitive).
+ * @param name The phase name
+ * @return The AP_REQUEST_PHASE_* value, or -1 if the name is unknown
+ */
+AP_DECLARE(int) ap_request_phase_lookup(const char *name);
+
+/**
+ * Get the time spent by a request in a processing phase.
+ * @param r The request
+ * @param phase The AP_REQUEST_PHASE_* value
+ * @return The time spent in microseconds, or -1 if the phases of this
+ *         request are not being timed
+ */
+AP_DECLARE(apr_interval_time_t) ap_request_phase_time(const request_rec *r,
+                                                      int phase);
+
 /**
  * Create a subrequest from the given URI.  This subrequest can be
  * inspected to find information about the requested URI
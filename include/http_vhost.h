@@ -86,6 +86,18 @@ AP_DECLARE(int) ap_vhost_iterate_given_conn(conn_rec *conn,
                                             ap_vhost_iterate_conn_cb func_cb,
                                             void* baton);
 
+/**
+ * Find the first virtual host of the connection, in the order of
+ * ap_vhost_iterate_given_conn(), whose ServerName or ServerAlias matches
+ * the given host name. The names are hashed at startup, so this does not
+ * walk all the virtual hosts of the address (e.g. for SNI).
+ * @param conn The current connection
+ * @param host The host name to look up
+ * @return The matching server_rec, or NULL if none matches
+ */
+AP_DECLARE(server_rec *) ap_vhost_find_given_conn(conn_rec *conn,
+                                                  const char *host);
+
 /**
  * given an ip address only, give our best guess as to what vhost it is
  * @param conn The current connection
@@ -1969,6 +1969,18 @@ AP_DECLARE(apr_size_t) ap_escape_errorlog_item(char *dest, const char *source,
                                                apr_size_t buflen)
                        AP_FN_ATTR_NONNULL((1));
 
+/**
+ * Escape a string for use inside a JSON string literal. Non-ASCII
+ * characters are written as \\uXXXX escapes (UTF-16 surrogate pairs
+ * beyond the BMP), bytes that are not valid UTF-8 are taken for
+ * ISO-8859-1, so the result is always valid ASCII JSON.
+ * @param dest The buffer to write to, or NULL to only compute the length
+ * @param source The string to escape, NULL is treated as ""
+ * @return The length of the escaped string. The buffer must be large
+ *         enough to hold that many bytes plus a terminating "\0"
+ */
+AP_DECLARE(apr_size_t) ap_escape_json(char *dest, const char *source);
+
 /**
  * Construct a full hostname
  * @param p The pool to allocate from
@@ -225,13 +225,15 @@ AP_DECLARE(global_score *) ap_get_scoreboard_global(void);
 AP_DECLARE_DATA extern scoreboard *ap_scoreboard_image;
 AP_DECLARE_DATA extern const char *ap_scoreboard_fname;
 AP_DECLARE_DATA extern int ap_extended_status;
+AP_DECLARE_DATA extern int ap_extended_status_lite;
 AP_DECLARE_DATA extern int ap_mod_status_reqtail;
 
 /*
  * Command handlers [internal]
  */
 const char *ap_set_scoreboard(cmd_parms *cmd, void *dummy, const char *arg);
-const char *ap_set_extended_status(cmd_parms *cmd, void *dummy, int arg);
+const char *ap_set_extended_status(cmd_parms *cmd, void *dummy,
+                                   const char *arg);
 const char *ap_set_reqtail(cmd_parms *cmd, void *dummy, int arg);
 
 /* Hooks */
@@ -192,6 +192,60 @@ if (o) return *o;],
   fi
 ])
 
+APACHE_MODULE(zstd, Zstandard compression support, , , most, [
+  AC_ARG_WITH(zstd, APACHE_HELP_STRING(--with-zstd=PATH,Zstandard installation directory),[
+    if test "$withval" != "yes" -a "x$withval" != "x"; then
+      ap_zstd_base="$withval"
+      ap_zstd_with=yes
+    fi
+  ])
+  ap_zstd_found=no
+  if test -n "$ap_zstd_base"; then
+    ap_save_cppflags=$CPPFLAGS
+    APR_ADDTO(CPPFLAGS, [-I${ap_zstd_base}/include])
+    AC_MSG_CHECKING([for Zstandard library >= 1.4.0 via prefix])
+    AC_TRY_COMPILE(
+      [#include <zstd.h>],[
+#if ZSTD_VERSION_NUMBER < 10400
+#error zstd too old
+#endif
+return ZSTD_compressStream2((ZSTD_CCtx*)0, (ZSTD_outBuffer*)0, (ZSTD_inBuffer*)0, ZSTD_e_end) != 0;],
+      [AC_MSG_RESULT(yes)
+       ap_zstd_found=yes
+       ap_zstd_cflags="-I${ap_zstd_base}/include"
+       ap_zstd_libs="-L${ap_zstd_base}/lib -lzstd"],
+      [AC_MSG_RESULT(no)]
+    )
+    CPPFLAGS=$ap_save_cppflags
+  else
+    if test -n "$PKGCONFIG"; then
+      AC_MSG_CHECKING([for Zstandard library >= 1.4.0 via pkg-config])
+      if $PKGCONFIG --exists "libzstd >= 1.4.0"; then
+        AC_MSG_RESULT(yes)
+        ap_zstd_found=yes
+        ap_zstd_cflags=`$PKGCONFIG libzstd --cflags`
+        ap_zstd_libs=`$PKGCONFIG libzstd --libs`
+      else
+        AC_MSG_RESULT(no)
+      fi
+    fi
+  fi
+  if test "$ap_zstd_found" = "yes"; then
+    APR_ADDTO(MOD_CFLAGS, [$ap_zstd_cflags])
+    APR_ADDTO(MOD_ZSTD_LDADD, [$ap_zstd_libs])
+    if test "$enable_zstd" = "shared"; then
+      dnl The only symbol which needs to be exported is the module
+      dnl structure, so ask libtool to hide everything else:
+      APR_ADDTO(MOD_ZSTD_LDADD, [-export-symbols-regex zstd_module])
+    fi
+  else
+    enable_zstd=no
+    if test "$ap_zstd_with" = "yes"; then
+      AC_MSG_ERROR([Zstandard library was missing or unusable])
+    fi
+  fi
+])
+
 APACHE_MODULE(crypto, Symmetrical encryption / decryption, , , no, [
   dnl Check for the required APR-util version.
   AC_MSG_CHECKING([for APR-util >= 1.6])
@@ -73,10 +73,15 @@ typedef struct deflate_filter_config_t
     int etag_opt;
 } deflate_filter_config;
 
+#define AP_DEFLATE_PRECOMP_UNSET -1
+#define AP_DEFLATE_PRECOMP_OFF    0
+#define AP_DEFLATE_PRECOMP_ON     1
+
 typedef struct deflate_dirconf_t {
     apr_off_t inflate_limit;
     int ratio_limit,
         ratio_burst;
+    int precompressed;
 } deflate_dirconf_t;
 
 /* RFC 1952 Section 2.3 defines the gzip header:
@@ -224,6 +229,22 @@ static void *create_deflate_dirconf(apr_pool_t *p, char *dummy)
     deflate_dirconf_t *dc = apr_pcalloc(p, sizeof(*dc));
     dc->ratio_limit = AP_INFLATE_RATIO_LIMIT;
     dc->ratio_burst = AP_INFLATE_RATIO_BURST;
+    dc->precompressed = AP_DEFLATE_PRECOMP_UNSET;
+    return dc;
+}
+
+static void *merge_deflate_dirconf(apr_pool_t *p, void *basev, void *addv)
+{
+    deflate_dirconf_t *base = basev;
+    deflate_dirconf_t *add = addv;
+    deflate_dirconf_t *dc = apr_pmemdup(p, add, sizeof(*dc));
+
+    /* The inflate settings have always been overridden as a whole by
+     * the most specific section, only DeflatePrecompressed inherits.
+     */
+    if (add->precompressed == AP_DEFLATE_PRECOMP_UNSET) {
+        dc->precompressed = base->precompressed;
+    }
     return dc;
 }
 
@@ -342,6 +363,16 @@ static const char *deflate_set_compressionlevel(cmd_parms *cmd, void *dummy,
 }
 
 
+static const char *deflate_set_precompressed(cmd_parms *cmd, void *dirconf,
+                                             int flag)
+{
+    deflate_dirconf_t *dc = (deflate_dirconf_t*) dirconf;
+
+    dc->precompressed = flag ? AP_DEFLATE_PRECOMP_ON : AP_DEFLATE_PRECOMP_OFF;
+
+    return NULL;
+}
+
 static const char *deflate_set_inflate_limit(cmd_parms *cmd, void *dirconf,
                                       const char *arg)
 {
@@ -1895,6 +1926,120 @@ static apr_status_t inflate_out_filter(ap_filter_t *f,
     return APR_SUCCESS;
 }
 
+/* Check whether the client accepts the content-coding `coding`
+ * in its Accept-Encoding header, with a qvalue other than 0.
+ */
+static int accepts_coding(request_rec *r, const char *accepts,
+                          const char *coding)
+{
+    char *token;
+    const char *q = NULL;
+
+    if (!accepts) {
+        return 0;
+    }
+
+    token = ap_get_token(r->pool, &accepts, 0);
+    while (token && token[0] && ap_cstr_casecmp(token, coding)) {
+        while (*accepts == ';') {
+            ++accepts;
+            ap_get_token(r->pool, &accepts, 1);
+        }
+        if (*accepts == ',') {
+            ++accepts;
+        }
+        token = (*accepts) ? ap_get_token(r->pool, &accepts, 0) : NULL;
+    }
+    if (!token || token[0] == '\0') {
+        return 0;
+    }
+
+    if (*accepts) {
+        while (*accepts == ';') {
+            ++accepts;
+        }
+        q = ap_get_token(r->pool, &accepts, 1);
+    }
+    return !(q && strlen(q) >= 3 && strncmp("q=0.000", q, strlen(q)) == 0);
+}
+
+/* Try to switch the request over to a pre-compressed sibling of the
+ * requested file, e.g. "foo.js.br" or "foo.js.gz" for "foo.js".
+ * The sibling is looked up with a subrequest, so that symlink options,
+ * <Files > sections and access control apply to it like to any other
+ * file. It is only used when it is a regular file that is at least
+ * as recent as the original. Content-Type has already been determined
+ * from the original name, we only add the Content-Encoding.
+ */
+static int try_precompressed(request_rec *r, const char *accepts,
+                             const char *coding, const char *ext)
+{
+    request_rec *rr;
+    const char *name;
+    int found = 0;
+
+    if (!accepts_coding(r, accepts, coding)) {
+        return 0;
+    }
+
+    name = ap_strrchr_c(r->filename, '/');
+    name = apr_pstrcat(r->pool, name ? name + 1 : r->filename, ext, NULL);
+    rr = ap_sub_req_lookup_file(name, r, NULL);
+    if (rr->status == HTTP_OK
+        && rr->finfo.filetype == APR_REG
+        && rr->finfo.mtime >= r->finfo.mtime) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                      "Serving pre-compressed %s for %s",
+                      rr->filename, r->filename);
+        r->filename = apr_pstrdup(r->pool, rr->filename);
+        r->finfo = rr->finfo;
+        r->finfo.fname = r->filename;
+        r->content_encoding = coding;
+        /* don't let DEFLATE or BROTLI filters touch it again */
+        apr_table_setn(r->subprocess_env, "no-gzip", "1");
+        apr_table_setn(r->subprocess_env, "no-brotli", "1");
+        found = 1;
+    }
+    ap_destroy_sub_req(rr);
+    return found;
+}
+
+static int deflate_precompressed_fixups(request_rec *r)
+{
+    deflate_dirconf_t *dc;
+    const char *accepts;
+
+    dc = ap_get_module_config(r->per_dir_config, &deflate_module);
+    /* Not for subrequests, their content is part of another response
+     * (this also skips our own lookups of the siblings). */
+    if (dc->precompressed != AP_DEFLATE_PRECOMP_ON
+        || r->main
+        || (r->method_number != M_GET)
+        || !r->filename
+        || (r->finfo.filetype != APR_REG)
+        || r->content_encoding
+        || (r->handler && strcmp(r->handler, "default-handler")
+            && (!r->content_type || strcmp(r->handler, r->content_type)))
+        || apr_table_get(r->subprocess_env, "no-gzip")) {
+        return DECLINED;
+    }
+
+    /* The selected representation depends on Accept-Encoding, whether
+     * we find a sibling or not.
+     */
+    apr_table_mergen(r->headers_out, "Vary", "Accept-Encoding");
+
+    accepts = apr_table_get(r->headers_in, "Accept-Encoding");
+    if (!accepts) {
+        return DECLINED;
+    }
+
+    if (!try_precompressed(r, accepts, "br", ".br")) {
+        try_precompressed(r, accepts, "gzip", ".gz");
+    }
+    return DECLINED;
+}
+
 static int mod_deflate_post_config(apr_pool_t *pconf, apr_pool_t *plog,
                                    apr_pool_t *ptemp, server_rec *s)
 {
@@ -1912,6 +2057,7 @@ static void register_hooks(apr_pool_t *p)
     ap_register_input_filter(deflateFilterName, deflate_in_filter, NULL,
                               AP_FTYPE_CONTENT_SET);
     ap_hook_post_config(mod_deflate_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_fixups(deflate_precompressed_fixups, NULL, NULL, APR_HOOK_LAST);
 }
 
 static const command_rec deflate_filter_cmds[] = {
@@ -1935,6 +2081,9 @@ static const command_rec deflate_filter_cmds[] = {
     AP_INIT_TAKE1("DeflateInflateRatioBurst", deflate_set_inflate_ratio_burst, NULL, OR_ALL,
                   "Set the maximum number of following inflate ratios above limit "
                   "(default: " APR_STRINGIFY(AP_INFLATE_RATIO_BURST) ")"),
+    AP_INIT_FLAG("DeflatePrecompressed", deflate_set_precompressed, NULL, OR_FILEINFO,
+                  "Serve existing .br/.gz siblings of files to clients "
+                  "accepting that encoding"),
     {NULL}
 };
 
@@ -1945,7 +2094,7 @@ static const command_rec deflate_filter_cmds[] = {
 AP_DECLARE_MODULE(deflate) = {
     STANDARD20_MODULE_STUFF,
     create_deflate_dirconf,       /* dir config creater */
-    NULL,                         /* dir merger --- default is to override */
+    merge_deflate_dirconf,        /* dir merger */
     create_deflate_server_config, /* server config */
     NULL,                         /* merge server config */
     deflate_filter_cmds,          /* command table */
@@ -14,16 +14,57 @@
  * limitations under the License.
  */
 
+#include "apr_atomic.h"
+#include "apr_hash.h"
+#include "apr_lib.h"
+#include "apr_strings.h"
+
 #include "httpd.h"
 #include "http_config.h"
 #include "http_log.h"
+#include "http_protocol.h"
+#include "http_request.h"
 #include "util_filter.h"
+#include "ap_expr.h"
+#include "ap_provider.h"
+#include "ap_slotmem.h"
 
 #include "mod_ratelimit.h"
 
+module AP_MODULE_DECLARE_DATA ratelimit_module;
+
 #define RATE_LIMIT_FILTER_NAME "RATE_LIMIT"
 #define RATE_INTERVAL_MS (200)
 
+/*
+ * Request rate limiting (RateLimitRequests).
+ *
+ * Each key (client IP or expression) is hashed to a slot of a table in
+ * shared memory (slotmem_shm), shared by all the children. A slot holds
+ * the "theoretical arrival time" of the Generic Cell Rate Algorithm, a
+ * token bucket that fits in a single 32bit word of milliseconds, so it
+ * is updated lock free with a compare-and-swap. Keys colliding in a slot
+ * share its bucket, RateLimitSlots should be large enough for the
+ * number of active keys. The bucket may have been filled by a directive
+ * with another rate, so an arrival time is only taken as stale once it
+ * is further ahead than any directive ever sets it.
+ */
+#define RL_DEFAULT_SLOTS 65536
+
+typedef struct rl_dir_conf {
+    int set;
+    apr_uint32_t interval;      /* ms between two requests, 0 for none */
+    apr_uint32_t tolerance;     /* burst tolerance in ms */
+    apr_uint32_t salt;          /* distinguishes the directives' keys */
+    ap_expr_info_t *key;        /* NULL for the client IP */
+} rl_dir_conf;
+
+static unsigned int rl_num_slots = RL_DEFAULT_SLOTS;
+static int rl_requests_used = 0;
+static apr_uint32_t rl_max_ahead = 0;
+static const ap_slotmem_provider_t *rl_storage = NULL;
+static ap_slotmem_instance_t *rl_slots = NULL;
+
 typedef enum rl_state_e
 {
     RATE_LIMIT,
@@ -322,19 +363,243 @@ AP_RL_DECLARE_DATA const apr_bucket_type_t ap_rl_bucket_type_start = {
 
 
 
+static int rl_check_request(request_rec *r)
+{
+    rl_dir_conf *conf = ap_get_module_config(r->per_dir_config,
+                                             &ratelimit_module);
+    const char *key;
+    apr_uint32_t *tat, now, old, cur, hash;
+    apr_int32_t ahead;
+    apr_ssize_t len;
+
+    if (!conf->interval || !rl_slots || !ap_is_initial_req(r)) {
+        return DECLINED;
+    }
+
+    if (conf->key) {
+        const char *err = NULL;
+
+        key = ap_expr_str_exec(r, conf->key, &err);
+        if (err) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10467)
+                          "RateLimitRequests: can't evaluate key: %s", err);
+            return DECLINED;
+        }
+    }
+    else {
+        key = r->useragent_ip;
+    }
+    if (!key) {
+        return DECLINED;
+    }
+
+    len = APR_HASH_KEY_STRING;
+    hash = (apr_hashfunc_default(key, &len) ^ conf->salt) * 0x9E3779B1u;
+    if (rl_storage->dptr(rl_slots, hash % rl_num_slots,
+                         (void **)&tat) != APR_SUCCESS) {
+        return DECLINED;
+    }
+
+    /* Milliseconds wrap around every 49 days, only differences matter */
+    now = (apr_uint32_t)apr_time_as_msec(apr_time_now());
+    do {
+        cur = old = apr_atomic_read32(tat);
+        ahead = (apr_int32_t)(cur - now);
+        /* An arrival time in the past is a full bucket; one further in
+         * the future than any directive ever sets is stale (wrapped),
+         * reset it.
+         */
+        if (ahead < 0 || ahead > (apr_int32_t)rl_max_ahead) {
+            cur = now;
+            ahead = 0;
+        }
+        if (ahead > (apr_int32_t)conf->tolerance) {
+            apr_uint32_t wait = ahead - conf->tolerance;
+
+            apr_table_setn(r->err_headers_out, "Retry-After",
+                           apr_psprintf(r->pool, "%u",
+                                        (unsigned int)(wait + 999) / 1000));
+            ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, APLOGNO(10468)
+                          "RateLimitRequests: too many requests for %s", key);
+            return HTTP_TOO_MANY_REQUESTS;
+        }
+    } while (apr_atomic_cas32(tat, cur + conf->interval, old) != old);
+
+    return DECLINED;
+}
+
+static int rl_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+                          apr_pool_t *ptemp, server_rec *s)
+{
+    apr_status_t rv;
+
+    rl_slots = NULL;
+    if (!rl_requests_used
+        || ap_state_query(AP_SQ_MAIN_STATE) != AP_SQ_MS_CREATE_CONFIG) {
+        return OK;
+    }
+
+    rl_storage = ap_lookup_provider(AP_SLOTMEM_PROVIDER_GROUP, "shm",
+                                    AP_SLOTMEM_PROVIDER_VERSION);
+    if (!rl_storage) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(10469)
+                     "RateLimitRequests: failed to lookup provider 'shm' "
+                     "for '%s', maybe you need to load mod_slotmem_shm?",
+                     AP_SLOTMEM_PROVIDER_GROUP);
+        return !OK;
+    }
+    rv = rl_storage->create(&rl_slots, "mod_ratelimit", sizeof(apr_uint32_t),
+                            rl_num_slots, 0, pconf);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(10470)
+                     "RateLimitRequests: slotmem_create failed");
+        return !OK;
+    }
+    return OK;
+}
+
+static int rl_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
+                         apr_pool_t *ptemp)
+{
+    rl_num_slots = RL_DEFAULT_SLOTS;
+    rl_requests_used = 0;
+    rl_max_ahead = 0;
+    return OK;
+}
+
+static void *create_rl_dir_conf(apr_pool_t *p, char *dummy)
+{
+    return apr_pcalloc(p, sizeof(rl_dir_conf));
+}
+
+static void *merge_rl_dir_conf(apr_pool_t *p, void *basev, void *addv)
+{
+    rl_dir_conf *add = addv;
+
+    return add->set ? add : basev;
+}
+
+/* RateLimitRequests off|<n>/<s|m|h> [burst=<n>] [key=<expr>] */
+static const char *set_rate_limit_requests(cmd_parms *cmd, void *dconf,
+                                           int argc, char *const argv[])
+{
+    rl_dir_conf *conf = dconf;
+    apr_int64_t unit = 0, requests, burst = 0;
+    apr_ssize_t len = APR_HASH_KEY_STRING;
+    char *end;
+    int i;
+
+    if (argc < 1) {
+        return "RateLimitRequests needs a rate or \"off\"";
+    }
+    conf->set = 1;
+    conf->interval = 0;
+    conf->key = NULL;
+    if (!strcasecmp(argv[0], "off")) {
+        return argc > 1 ? "RateLimitRequests off takes no options" : NULL;
+    }
+
+    requests = apr_strtoi64(argv[0], &end, 10);
+    if (end[0] == '/' && end[1] && !end[2]) {
+        switch (apr_tolower(end[1])) {
+        case 's': unit = 1000; break;
+        case 'm': unit = 60 * 1000; break;
+        case 'h': unit = 60 * 60 * 1000; break;
+        }
+    }
+    if (!unit || requests <= 0 || requests > unit) {
+        return "RateLimitRequests needs a rate like 10/s, 600/m or 5000/h, "
+               "of at most 1000 requests per second";
+    }
+
+    for (i = 1; i < argc; ++i) {
+        if (!strncasecmp(argv[i], "burst=", 6)) {
+            burst = apr_strtoi64(argv[i] + 6, &end, 10);
+            if (*end || burst <= 0 || burst > requests * 100) {
+                return "RateLimitRequests burst= needs a positive number, "
+                       "up to 100 times the rate";
+            }
+        }
+        else if (!strncasecmp(argv[i], "key=", 4)) {
+            const char *err = NULL;
+
+            conf->key = ap_expr_parse_cmd(cmd, argv[i] + 4,
+                                          AP_EXPR_FLAG_STRING_RESULT,
+                                          &err, NULL);
+            if (err) {
+                return apr_pstrcat(cmd->pool, "RateLimitRequests key=: ",
+                                   err, NULL);
+            }
+        }
+        else {
+            return apr_pstrcat(cmd->pool, "RateLimitRequests: unknown "
+                               "option ", argv[i], NULL);
+        }
+    }
+
+    /* By default, a whole unit's worth of requests may come at once */
+    if (!burst) {
+        burst = requests;
+    }
+    conf->interval = (apr_uint32_t)(unit / requests);
+    conf->tolerance = (apr_uint32_t)((burst - 1) * conf->interval);
+    if (rl_max_ahead < conf->tolerance + conf->interval) {
+        rl_max_ahead = conf->tolerance + conf->interval;
+    }
+    conf->salt = (apr_uint32_t)apr_hashfunc_default(
+                     apr_psprintf(cmd->temp_pool, "%s:%d",
+                                  cmd->directive->filename,
+                                  cmd->directive->line_num), &len);
+    rl_requests_used = 1;
+
+    return NULL;
+}
+
+static const char *set_rate_limit_slots(cmd_parms *cmd, void *dummy,
+                                        const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_int64_t n;
+    char *end;
+
+    if (err) {
+        return err;
+    }
+    n = apr_strtoi64(arg, &end, 10);
+    if (*end || n < 1 || n > 16 * 1024 * 1024) {
+        return "RateLimitSlots needs a number between 1 and 16777216";
+    }
+    rl_num_slots = (unsigned int)n;
+    return NULL;
+}
+
+static const command_rec rl_cmds[] =
+{
+    AP_INIT_TAKE_ARGV("RateLimitRequests", set_rate_limit_requests, NULL,
+                      RSRC_CONF|ACCESS_CONF, "Limit the request rate: off or <n>/<s|m|h> "
+                      "[burst=<n>] [key=<expression>]"),
+    AP_INIT_TAKE1("RateLimitSlots", set_rate_limit_slots, NULL, RSRC_CONF,
+                  "Number of shared slots for RateLimitRequests keys"),
+    {NULL}
+};
+
 static void register_hooks(apr_pool_t *p)
 {
     /* run after mod_deflate etc etc, but not at connection level, ie, mod_ssl. */
     ap_register_output_filter(RATE_LIMIT_FILTER_NAME, rate_limit_filter,
                               NULL, AP_FTYPE_CONNECTION - 1);
+
+    ap_hook_pre_config(rl_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_post_config(rl_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_header_parser(rl_check_request, NULL, NULL, APR_HOOK_FIRST);
 }
 
 AP_DECLARE_MODULE(ratelimit) = {
     STANDARD20_MODULE_STUFF,
-    NULL,                       /* create per-directory config structure */
-    NULL,                       /* merge per-directory config structures */
+    create_rl_dir_conf,         /* create per-directory config structure */
+    merge_rl_dir_conf,          /* merge per-directory config structures */
     NULL,                       /* create per-server config structure */
     NULL,                       /* merge per-server config structures */
-    NULL,                       /* command apr_table_t */
+    rl_cmds,                    /* command apr_table_t */
     register_hooks
 };
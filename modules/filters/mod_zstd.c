@@ -0,0 +1,827 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * mod_zstd.c: Zstandard content-encoding (RFC 8878, RFC 9659) with
+ * optional Compression Dictionary Transport (RFC 9842, "dcz").
+ */
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_core.h"
+#include "http_log.h"
+#include "apr_lib.h"
+#include "apr_strings.h"
+#include "apr_base64.h"
+
+#include <zstd.h>
+
+module AP_MODULE_DECLARE_DATA zstd_module;
+
+#define SHA256_LEN 32
+
+/* RFC 9842, 4: a "dcz" encoded body starts with a zstd skippable frame
+ * magic, followed by the SHA-256 of the dictionary used. */
+static const unsigned char dcz_magic[8] =
+{ 0x5e, 0x2a, 0x4d, 0x18, 0x20, 0x00, 0x00, 0x00 };
+
+typedef enum {
+    ETAG_MODE_ADDSUFFIX = 0,
+    ETAG_MODE_NOCHANGE = 1,
+    ETAG_MODE_REMOVE = 2
+} etag_mode_e;
+
+typedef struct zstd_dict_t {
+    const char *fname;
+    ZSTD_CDict *cdict;
+    unsigned char hash[SHA256_LEN];
+    const char *hash_b64;
+} zstd_dict_t;
+
+typedef struct zstd_server_config_t {
+    int level;
+    unsigned int level_set:1;
+    unsigned int etag_set:1;
+    etag_mode_e etag_mode;
+    zstd_dict_t *dict;
+    const char *note_ratio_name;
+    const char *note_input_name;
+    const char *note_output_name;
+} zstd_server_config_t;
+
+/*
+ * A minimal SHA-256 (FIPS 180-4), only used once per dictionary at
+ * startup to compute the identifier clients send in the
+ * Available-Dictionary header.
+ */
+
+static const apr_uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(apr_uint32_t h[8], const unsigned char *p)
+{
+    apr_uint32_t w[64], a, b, c, d, e, f, g, hh, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; ++i) {
+        w[i] = ((apr_uint32_t)p[4*i] << 24) | ((apr_uint32_t)p[4*i+1] << 16)
+             | ((apr_uint32_t)p[4*i+2] << 8) | (apr_uint32_t)p[4*i+3];
+    }
+    for (i = 16; i < 64; ++i) {
+        apr_uint32_t s0 = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3);
+        apr_uint32_t s1 = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    a = h[0]; b = h[1]; c = h[2]; d = h[3];
+    e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+    for (i = 0; i < 64; ++i) {
+        t1 = hh + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25))
+                + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22))
+                + ((a & b) ^ (a & c) ^ (b & c));
+        hh = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+static void sha256(unsigned char out[SHA256_LEN],
+                   const unsigned char *data, apr_size_t len)
+{
+    apr_uint32_t h[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    unsigned char tail[128];
+    apr_uint64_t bits = (apr_uint64_t)len * 8;
+    apr_size_t i, rest, tlen;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        sha256_block(h, data + i);
+    }
+    rest = len - i;
+    memcpy(tail, data + i, rest);
+    tail[rest] = 0x80;
+    tlen = (rest < 56) ? 64 : 128;
+    memset(tail + rest + 1, 0, tlen - rest - 1);
+    for (i = 0; i < 8; ++i) {
+        tail[tlen - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    sha256_block(h, tail);
+    if (tlen == 128) {
+        sha256_block(h, tail + 64);
+    }
+    for (i = 0; i < 8; ++i) {
+        out[4*i]   = (unsigned char)(h[i] >> 24);
+        out[4*i+1] = (unsigned char)(h[i] >> 16);
+        out[4*i+2] = (unsigned char)(h[i] >> 8);
+        out[4*i+3] = (unsigned char)h[i];
+    }
+}
+
+static void *create_server_config(apr_pool_t *p, server_rec *s)
+{
+    zstd_server_config_t *conf = apr_pcalloc(p, sizeof(*conf));
+
+    /* Level 3 is zstd's own default; it is faster than mod_deflate's
+     * default while compressing better. */
+    conf->level = 3;
+    conf->etag_mode = ETAG_MODE_ADDSUFFIX;
+
+    return conf;
+}
+
+static void *merge_server_config(apr_pool_t *p, void *basev, void *addv)
+{
+    zstd_server_config_t *base = basev;
+    zstd_server_config_t *add = addv;
+    zstd_server_config_t *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->level = add->level_set ? add->level : base->level;
+    conf->level_set = add->level_set || base->level_set;
+    conf->etag_mode = add->etag_set ? add->etag_mode : base->etag_mode;
+    conf->etag_set = add->etag_set || base->etag_set;
+    conf->dict = add->dict ? add->dict : base->dict;
+    conf->note_ratio_name = add->note_ratio_name ? add->note_ratio_name
+                                                 : base->note_ratio_name;
+    conf->note_input_name = add->note_input_name ? add->note_input_name
+                                                 : base->note_input_name;
+    conf->note_output_name = add->note_output_name ? add->note_output_name
+                                                   : base->note_output_name;
+    return conf;
+}
+
+static const char *set_filter_note(cmd_parms *cmd, void *dummy,
+                                   const char *arg1, const char *arg2)
+{
+    zstd_server_config_t *conf =
+        ap_get_module_config(cmd->server->module_config, &zstd_module);
+
+    if (!arg2) {
+        conf->note_ratio_name = arg1;
+        return NULL;
+    }
+
+    if (ap_cstr_casecmp(arg1, "Ratio") == 0) {
+        conf->note_ratio_name = arg2;
+    }
+    else if (ap_cstr_casecmp(arg1, "Input") == 0) {
+        conf->note_input_name = arg2;
+    }
+    else if (ap_cstr_casecmp(arg1, "Output") == 0) {
+        conf->note_output_name = arg2;
+    }
+    else {
+        return apr_psprintf(cmd->pool, "Unknown ZstdFilterNote type '%s'",
+                            arg1);
+    }
+
+    return NULL;
+}
+
+static const char *set_compression_level(cmd_parms *cmd, void *dummy,
+                                         const char *arg)
+{
+    zstd_server_config_t *conf =
+        ap_get_module_config(cmd->server->module_config, &zstd_module);
+    int val = atoi(arg);
+
+    if (val < 1 || val > 19) {
+        return "ZstdCompressionLevel must be between 1 and 19";
+    }
+
+    conf->level = val;
+    conf->level_set = 1;
+    return NULL;
+}
+
+static const char *set_etag_mode(cmd_parms *cmd, void *dummy,
+                                 const char *arg)
+{
+    zstd_server_config_t *conf =
+        ap_get_module_config(cmd->server->module_config, &zstd_module);
+
+    if (ap_cstr_casecmp(arg, "AddSuffix") == 0) {
+        conf->etag_mode = ETAG_MODE_ADDSUFFIX;
+    }
+    else if (ap_cstr_casecmp(arg, "NoChange") == 0) {
+        conf->etag_mode = ETAG_MODE_NOCHANGE;
+    }
+    else if (ap_cstr_casecmp(arg, "Remove") == 0) {
+        conf->etag_mode = ETAG_MODE_REMOVE;
+    }
+    else {
+        return "ZstdAlterETag accepts only 'AddSuffix', 'NoChange' and 'Remove'";
+    }
+
+    conf->etag_set = 1;
+    return NULL;
+}
+
+static const char *set_dictionary(cmd_parms *cmd, void *dummy,
+                                  const char *arg)
+{
+    zstd_server_config_t *conf =
+        ap_get_module_config(cmd->server->module_config, &zstd_module);
+
+    conf->dict = apr_pcalloc(cmd->pool, sizeof(*conf->dict));
+    conf->dict->fname = ap_server_root_relative(cmd->pool, arg);
+    if (!conf->dict->fname) {
+        return apr_pstrcat(cmd->pool, "Invalid ZstdDictionary path ",
+                           arg, NULL);
+    }
+    return NULL;
+}
+
+static apr_status_t cleanup_cdict(void *data)
+{
+    zstd_dict_t *dict = data;
+
+    ZSTD_freeCDict(dict->cdict);
+    dict->cdict = NULL;
+    return APR_SUCCESS;
+}
+
+/* Load the dictionary file and prepare it for compression at the
+ * configured level. This happens once in the parent, children share
+ * the (read-only) prepared dictionary after fork(). */
+static apr_status_t load_dictionary(zstd_dict_t *dict, int level,
+                                    apr_pool_t *p, server_rec *s)
+{
+    apr_file_t *fd;
+    apr_finfo_t finfo;
+    apr_size_t len;
+    char *buf, *b64;
+    apr_status_t rv;
+
+    rv = apr_file_open(&fd, dict->fname, APR_FOPEN_READ | APR_FOPEN_BINARY,
+                       APR_OS_DEFAULT, p);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(10450)
+                     "ZstdDictionary: unable to open '%s'", dict->fname);
+        return rv;
+    }
+    rv = apr_file_info_get(&finfo, APR_FINFO_SIZE, fd);
+    if (rv == APR_SUCCESS) {
+        len = (apr_size_t)finfo.size;
+        buf = apr_palloc(p, len ? len : 1);
+        rv = apr_file_read_full(fd, buf, len, NULL);
+    }
+    apr_file_close(fd);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(10451)
+                     "ZstdDictionary: unable to read '%s'", dict->fname);
+        return rv;
+    }
+
+    dict->cdict = ZSTD_createCDict(buf, len, level);
+    if (!dict->cdict) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(10452)
+                     "ZstdDictionary: unable to use '%s' as dictionary",
+                     dict->fname);
+        return APR_EGENERAL;
+    }
+    apr_pool_cleanup_register(p, dict, cleanup_cdict, apr_pool_cleanup_null);
+
+    sha256(dict->hash, (const unsigned char *)buf, len);
+    b64 = apr_palloc(p, apr_base64_encode_len(SHA256_LEN));
+    apr_base64_encode(b64, (const char *)dict->hash, SHA256_LEN);
+    dict->hash_b64 = b64;
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10453)
+                 "ZstdDictionary: loaded '%s' (%" APR_SIZE_T_FMT " bytes, "
+                 "sha-256 %s)", dict->fname, len, dict->hash_b64);
+    return APR_SUCCESS;
+}
+
+static int zstd_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+                            apr_pool_t *ptemp, server_rec *s)
+{
+    server_rec *sr;
+
+    if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
+        return OK;
+    }
+
+    for (sr = s; sr; sr = sr->next) {
+        zstd_server_config_t *conf =
+            ap_get_module_config(sr->module_config, &zstd_module);
+
+        /* vhosts inheriting the dictionary share its instance */
+        if (conf->dict && !conf->dict->cdict) {
+            if (load_dictionary(conf->dict, conf->level, pconf,
+                                sr) != APR_SUCCESS) {
+                return HTTP_INTERNAL_SERVER_ERROR;
+            }
+        }
+    }
+    return OK;
+}
+
+typedef struct zstd_ctx_t {
+    ZSTD_CCtx *cctx;
+    ZSTD_outBuffer out;
+    apr_bucket_brigade *bb;
+    apr_off_t total_in;
+    apr_off_t total_out;
+} zstd_ctx_t;
+
+static apr_status_t cleanup_ctx(void *data)
+{
+    zstd_ctx_t *ctx = data;
+
+    ZSTD_freeCCtx(ctx->cctx);
+    ctx->cctx = NULL;
+    return APR_SUCCESS;
+}
+
+static zstd_ctx_t *create_ctx(zstd_server_config_t *conf, zstd_dict_t *dict,
+                              apr_bucket_alloc_t *alloc, apr_pool_t *pool)
+{
+    zstd_ctx_t *ctx = apr_pcalloc(pool, sizeof(*ctx));
+
+    ctx->cctx = ZSTD_createCCtx();
+    if (!ctx->cctx) {
+        return NULL;
+    }
+    apr_pool_cleanup_register(pool, ctx, cleanup_ctx, apr_pool_cleanup_null);
+
+    if (dict) {
+        /* the level is taken from the prepared dictionary */
+        ZSTD_CCtx_refCDict(ctx->cctx, dict->cdict);
+    }
+    else {
+        ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_compressionLevel,
+                               conf->level);
+    }
+    /* Levels up to 19 use windows of at most 8MB, which is all
+     * RFC 9659 asks decoders to support. */
+    ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_checksumFlag, 1);
+
+    ctx->out.size = ZSTD_CStreamOutSize();
+    ctx->out.dst = apr_palloc(pool, ctx->out.size);
+    ctx->out.pos = 0;
+    ctx->bb = apr_brigade_create(pool, alloc);
+
+    return ctx;
+}
+
+static apr_status_t process_chunk(zstd_ctx_t *ctx,
+                                  const void *data,
+                                  apr_size_t len,
+                                  ap_filter_t *f)
+{
+    ZSTD_inBuffer in;
+
+    in.src = data;
+    in.size = len;
+    in.pos = 0;
+
+    while (in.pos < in.size) {
+        size_t rc = ZSTD_compressStream2(ctx->cctx, &ctx->out, &in,
+                                         ZSTD_e_continue);
+        if (ZSTD_isError(rc)) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, f->r, APLOGNO(10454)
+                          "Error while compressing data: %s",
+                          ZSTD_getErrorName(rc));
+            return APR_EGENERAL;
+        }
+
+        if (ctx->out.pos == ctx->out.size) {
+            apr_status_t rv;
+            apr_bucket *b;
+
+            /* The output buffer is reused after the brigade has been
+             * passed and cleaned up, so a transient bucket is enough. */
+            b = apr_bucket_transient_create(ctx->out.dst, ctx->out.pos,
+                                            ctx->bb->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(ctx->bb, b);
+            ctx->total_out += ctx->out.pos;
+            ctx->out.pos = 0;
+
+            rv = ap_pass_brigade(f->next, ctx->bb);
+            apr_brigade_cleanup(ctx->bb);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+        }
+    }
+
+    ctx->total_in += len;
+    return APR_SUCCESS;
+}
+
+static apr_status_t flush(zstd_ctx_t *ctx,
+                          ZSTD_EndDirective mode,
+                          ap_filter_t *f)
+{
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+    size_t remaining;
+
+    do {
+        remaining = ZSTD_compressStream2(ctx->cctx, &ctx->out, &in, mode);
+        if (ZSTD_isError(remaining)) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, f->r, APLOGNO(10455)
+                          "Error while compressing data: %s",
+                          ZSTD_getErrorName(remaining));
+            return APR_EGENERAL;
+        }
+
+        if (ctx->out.pos > 0) {
+            apr_bucket *b;
+
+            /* A flush can take several rounds, copy the output since
+             * the buffer is reused before the brigade is passed. */
+            b = apr_bucket_heap_create(ctx->out.dst, ctx->out.pos, NULL,
+                                       ctx->bb->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(ctx->bb, b);
+            ctx->total_out += ctx->out.pos;
+            ctx->out.pos = 0;
+        }
+    } while (remaining > 0);
+
+    return APR_SUCCESS;
+}
+
+static const char *get_content_encoding(request_rec *r)
+{
+    const char *encoding;
+
+    encoding = apr_table_get(r->headers_out, "Content-Encoding");
+    if (encoding) {
+        const char *err_enc;
+
+        err_enc = apr_table_get(r->err_headers_out, "Content-Encoding");
+        if (err_enc) {
+            encoding = apr_pstrcat(r->pool, encoding, ",", err_enc, NULL);
+        }
+    }
+    else {
+        encoding = apr_table_get(r->err_headers_out, "Content-Encoding");
+    }
+
+    if (r->content_encoding) {
+        encoding = encoding ? apr_pstrcat(r->pool, encoding, ",",
+                                          r->content_encoding, NULL)
+                            : r->content_encoding;
+    }
+
+    return encoding;
+}
+
+/* Check whether the client accepts the content-coding `coding`
+ * with a qvalue other than 0.
+ */
+static int accepts_coding(request_rec *r, const char *accepts,
+                          const char *coding)
+{
+    const char *token;
+    const char *q = NULL;
+
+    token = ap_get_token(r->pool, &accepts, 0);
+    while (token && token[0] && ap_cstr_casecmp(token, coding) != 0) {
+        while (*accepts == ';') {
+            ++accepts;
+            ap_get_token(r->pool, &accepts, 1);
+        }
+
+        if (*accepts == ',') {
+            ++accepts;
+        }
+        token = (*accepts) ? ap_get_token(r->pool, &accepts, 0) : NULL;
+    }
+    if (!token || token[0] == '\0') {
+        return 0;
+    }
+
+    if (*accepts) {
+        while (*accepts == ';') {
+            ++accepts;
+        }
+        q = ap_get_token(r->pool, &accepts, 1);
+    }
+    return !(q && strlen(q) >= 3 && strncmp("q=0.000", q, strlen(q)) == 0);
+}
+
+/* The client announces a dictionary it holds as a structured field
+ * byte sequence, i.e. ":<base64 of sha-256>:". */
+static int has_dictionary(request_rec *r, zstd_dict_t *dict)
+{
+    const char *avail;
+    apr_size_t len;
+
+    avail = apr_table_get(r->headers_in, "Available-Dictionary");
+    if (!avail) {
+        return 0;
+    }
+    while (apr_isspace(*avail)) {
+        ++avail;
+    }
+    len = strlen(avail);
+    while (len > 0 && apr_isspace(avail[len - 1])) {
+        --len;
+    }
+    return (len == strlen(dict->hash_b64) + 2
+            && avail[0] == ':' && avail[len - 1] == ':'
+            && !strncmp(avail + 1, dict->hash_b64, len - 2));
+}
+
+static apr_status_t compress_filter(ap_filter_t *f, apr_bucket_brigade *bb)
+{
+    request_rec *r = f->r;
+    zstd_ctx_t *ctx = f->ctx;
+    apr_status_t rv;
+    zstd_server_config_t *conf;
+
+    if (APR_BRIGADE_EMPTY(bb)) {
+        return APR_SUCCESS;
+    }
+
+    conf = ap_get_module_config(r->server->module_config, &zstd_module);
+
+    if (!ctx) {
+        const char *encoding;
+        const char *token;
+        const char *accepts;
+        const char *coding;
+        zstd_dict_t *dict = NULL;
+
+        /* Only work on main request, not subrequests, that are not
+         * a 204 response with no content, and are not tagged with the
+         * no-zstd env variable, and are not a partial response to
+         * a Range request.
+         *
+         * Note that responding to 304 is handled separately to set
+         * the required headers (such as ETag) per RFC7232, 4.1.
+         */
+        if (r->main || r->status == HTTP_NO_CONTENT
+            || apr_table_get(r->subprocess_env, "no-zstd")
+            || apr_table_get(r->headers_out, "Content-Range")) {
+            ap_remove_output_filter(f);
+            return ap_pass_brigade(f->next, bb);
+        }
+
+        /* Let's see what our current Content-Encoding is. */
+        encoding = get_content_encoding(r);
+
+        if (encoding) {
+            const char *tmp = encoding;
+
+            token = ap_get_token(r->pool, &tmp, 0);
+            while (token && *token) {
+                if (strcmp(token, "identity") != 0 &&
+                    strcmp(token, "7bit") != 0 &&
+                    strcmp(token, "8bit") != 0 &&
+                    strcmp(token, "binary") != 0) {
+                    /* The data is already encoded, do nothing. */
+                    ap_remove_output_filter(f);
+                    return ap_pass_brigade(f->next, bb);
+                }
+
+                if (*tmp) {
+                    ++tmp;
+                }
+                token = (*tmp) ? ap_get_token(r->pool, &tmp, 0) : NULL;
+            }
+        }
+
+        /* Even if we don't accept this request based on it not having
+         * the Accept-Encoding, we need to note that we were looking
+         * for this header and downstream proxies should be aware of
+         * that.
+         */
+        apr_table_mergen(r->headers_out, "Vary", "Accept-Encoding");
+        if (conf->dict) {
+            apr_table_mergen(r->headers_out, "Vary", "Available-Dictionary");
+        }
+
+        accepts = apr_table_get(r->headers_in, "Accept-Encoding");
+        if (!accepts) {
+            ap_remove_output_filter(f);
+            return ap_pass_brigade(f->next, bb);
+        }
+
+        if (conf->dict && has_dictionary(r, conf->dict)
+            && accepts_coding(r, accepts, "dcz")) {
+            dict = conf->dict;
+            coding = "dcz";
+        }
+        else if (accepts_coding(r, accepts, "zstd")) {
+            coding = "zstd";
+        }
+        else {
+            ap_remove_output_filter(f);
+            return ap_pass_brigade(f->next, bb);
+        }
+
+        /* If the entire Content-Encoding is "identity", we can replace it. */
+        if (!encoding || ap_cstr_casecmp(encoding, "identity") == 0) {
+            apr_table_setn(r->headers_out, "Content-Encoding", coding);
+        } else {
+            apr_table_mergen(r->headers_out, "Content-Encoding", coding);
+        }
+
+        if (r->content_encoding) {
+            r->content_encoding = apr_table_get(r->headers_out,
+                                                "Content-Encoding");
+        }
+
+        apr_table_unset(r->headers_out, "Content-Length");
+        apr_table_unset(r->headers_out, "Content-MD5");
+
+        /* ETag must be unique among the possible representations, see
+         * mod_brotli and mod_deflate. */
+        if (conf->etag_mode == ETAG_MODE_REMOVE) {
+            apr_table_unset(r->headers_out, "ETag");
+        }
+        else if (conf->etag_mode == ETAG_MODE_ADDSUFFIX) {
+            const char *etag = apr_table_get(r->headers_out, "ETag");
+
+            if (etag) {
+                apr_size_t len = strlen(etag);
+
+                if (len > 2 && etag[len - 1] == '"') {
+                    etag = apr_pstrmemdup(r->pool, etag, len - 1);
+                    etag = apr_pstrcat(r->pool, etag, "-", coding, "\"", NULL);
+                    apr_table_setn(r->headers_out, "ETag", etag);
+                }
+            }
+        }
+
+        /* For 304 responses, we only need to send out the headers. */
+        if (r->status == HTTP_NOT_MODIFIED) {
+            ap_remove_output_filter(f);
+            return ap_pass_brigade(f->next, bb);
+        }
+
+        ctx = create_ctx(conf, dict, f->c->bucket_alloc, r->pool);
+        if (!ctx) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10456)
+                          "Unable to create zstd compression context");
+            return APR_ENOMEM;
+        }
+        f->ctx = ctx;
+
+        if (dict) {
+            apr_bucket *b;
+            char *hdr = apr_bucket_alloc(sizeof(dcz_magic) + SHA256_LEN,
+                                         ctx->bb->bucket_alloc);
+
+            memcpy(hdr, dcz_magic, sizeof(dcz_magic));
+            memcpy(hdr + sizeof(dcz_magic), dict->hash, SHA256_LEN);
+            b = apr_bucket_heap_create(hdr, sizeof(dcz_magic) + SHA256_LEN,
+                                       apr_bucket_free, ctx->bb->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(ctx->bb, b);
+            ctx->total_out += sizeof(dcz_magic) + SHA256_LEN;
+        }
+    }
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        apr_bucket *e = APR_BRIGADE_FIRST(bb);
+
+        /* Optimization: If we are a HEAD request and bytes_sent is not zero
+         * it means that we have passed the content-length filter once and
+         * have more data to send.  This means that the content-length filter
+         * could not determine our content-length for the response to the
+         * HEAD request anyway (the associated GET request would deliver the
+         * body in chunked encoding) and we can stop compressing.
+         */
+        if (r->header_only && r->bytes_sent) {
+            ap_remove_output_filter(f);
+            return ap_pass_brigade(f->next, bb);
+        }
+
+        if (APR_BUCKET_IS_EOS(e)) {
+            rv = flush(ctx, ZSTD_e_end, f);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+
+            /* Leave notes for logging. */
+            if (conf->note_input_name) {
+                apr_table_setn(r->notes, conf->note_input_name,
+                               apr_off_t_toa(r->pool, ctx->total_in));
+            }
+            if (conf->note_output_name) {
+                apr_table_setn(r->notes, conf->note_output_name,
+                               apr_off_t_toa(r->pool, ctx->total_out));
+            }
+            if (conf->note_ratio_name) {
+                if (ctx->total_in > 0) {
+                    int ratio = (int) (ctx->total_out * 100 / ctx->total_in);
+
+                    apr_table_setn(r->notes, conf->note_ratio_name,
+                                   apr_itoa(r->pool, ratio));
+                }
+                else {
+                    apr_table_setn(r->notes, conf->note_ratio_name, "-");
+                }
+            }
+
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(ctx->bb, e);
+
+            rv = ap_pass_brigade(f->next, ctx->bb);
+            apr_brigade_cleanup(ctx->bb);
+            apr_pool_cleanup_run(r->pool, ctx, cleanup_ctx);
+            return rv;
+        }
+        else if (APR_BUCKET_IS_FLUSH(e)) {
+            rv = flush(ctx, ZSTD_e_flush, f);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(ctx->bb, e);
+
+            rv = ap_pass_brigade(f->next, ctx->bb);
+            apr_brigade_cleanup(ctx->bb);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+        }
+        else if (APR_BUCKET_IS_METADATA(e)) {
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(ctx->bb, e);
+        }
+        else {
+            const char *data;
+            apr_size_t len;
+
+            rv = apr_bucket_read(e, &data, &len, APR_BLOCK_READ);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            rv = process_chunk(ctx, data, len, f);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+            apr_bucket_delete(e);
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static void register_hooks(apr_pool_t *p)
+{
+    ap_register_output_filter("ZSTD_COMPRESS", compress_filter, NULL,
+                              AP_FTYPE_CONTENT_SET);
+    ap_hook_post_config(zstd_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+static const command_rec cmds[] = {
+    AP_INIT_TAKE12("ZstdFilterNote", set_filter_note,
+                   NULL, RSRC_CONF,
+                   "Set a note to report on compression ratio"),
+    AP_INIT_TAKE1("ZstdCompressionLevel", set_compression_level,
+                  NULL, RSRC_CONF,
+                  "Compression level between 1 and 19 (higher levels mean "
+                  "slower compression)"),
+    AP_INIT_TAKE1("ZstdAlterETag", set_etag_mode,
+                  NULL, RSRC_CONF,
+                  "Set how mod_zstd should modify ETag response headers: "
+                  "'AddSuffix' (default), 'NoChange', 'Remove'"),
+    AP_INIT_TAKE1("ZstdDictionary", set_dictionary,
+                  NULL, RSRC_CONF,
+                  "A raw or trained zstd dictionary offered to clients "
+                  "via Compression Dictionary Transport"),
+    {NULL}
+};
+
+AP_DECLARE_MODULE(zstd) = {
+    STANDARD20_MODULE_STUFF,
+    NULL,                      /* create per-directory config structure */
+    NULL,                      /* merge per-directory config structures */
+    create_server_config,      /* create per-server config structure */
+    merge_server_config,       /* merge per-server config structures */
+    cmds,                      /* command apr_table_t */
+    register_hooks             /* register hooks */
+};
@@ -158,6 +158,7 @@ static void show_time(request_rec *r, apr_uint32_t tsecs)
 #define STAT_OPT_REFRESH  0
 #define STAT_OPT_NOTABLE  1
 #define STAT_OPT_AUTO     2
+#define STAT_OPT_METRICS  3
 
 struct stat_opt {
     int id;
@@ -170,6 +171,7 @@ static const struct stat_opt status_options[] = /* see #defines above */
     {STAT_OPT_REFRESH, "refresh", "Refresh"},
     {STAT_OPT_NOTABLE, "notable", NULL},
     {STAT_OPT_AUTO, "auto", NULL},
+    {STAT_OPT_METRICS, "metrics", NULL},
     {STAT_OPT_END, NULL, NULL}
 };
 
@@ -179,6 +181,39 @@ static const struct stat_opt status_options[] = /* see #defines above */
 
 static char status_flags[MOD_STATUS_NUM_STATUS];
 
+/* the state label of the slots in the metrics report */
+static const char *status_names[MOD_STATUS_NUM_STATUS];
+
+#define METRICS_CONTENT_TYPE \
+    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* OpenMetrics label values only need \, " and newlines escaped */
+static const char *metrics_label(apr_pool_t *p, const char *s)
+{
+    char *d, *ret;
+
+    if (!ap_strchr_c(s, '\\') && !ap_strchr_c(s, '"')
+        && !ap_strchr_c(s, '\n')) {
+        return s;
+    }
+    ret = d = apr_palloc(p, 2 * strlen(s) + 1);
+    for (; *s; ++s) {
+        if (*s == '\\' || *s == '"') {
+            *d++ = '\\';
+            *d++ = *s;
+        }
+        else if (*s == '\n') {
+            *d++ = '\\';
+            *d++ = 'n';
+        }
+        else {
+            *d++ = *s;
+        }
+    }
+    *d = '\0';
+    return ret;
+}
+
 static int status_handler(request_rec *r)
 {
     const char *loc;
@@ -198,6 +233,8 @@ static int status_handler(request_rec *r)
     apr_time_t duration_slot;
     int short_report;
     int no_table_report;
+    int metrics_report;
+    int slots[MOD_STATUS_NUM_STATUS];
     global_score *global_record;
     worker_score *ws_record;
     process_score *ps_record;
@@ -242,6 +279,8 @@ static int status_handler(request_rec *r)
     duration_global = 0;
     short_report = 0;
     no_table_report = 0;
+    metrics_report = 0;
+    memset(slots, 0, sizeof(slots));
 
     if (!ap_exists_scoreboard_image()) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01237)
@@ -304,6 +343,9 @@ static int status_handler(request_rec *r)
                     ap_set_content_type(r, "text/plain; charset=ISO-8859-1");
                     short_report = 1;
                     break;
+                case STAT_OPT_METRICS:
+                    metrics_report = 1;
+                    break;
                 }
             }
 
@@ -332,10 +374,14 @@ static int status_handler(request_rec *r)
             res = ws_record->status;
 
             if ((i >= max_servers || j >= threads_per_child)
-                && (res == SERVER_DEAD))
+                && (res == SERVER_DEAD)) {
                 stat_buffer[indx] = status_flags[SERVER_DISABLED];
-            else
+                slots[SERVER_DISABLED]++;
+            }
+            else {
                 stat_buffer[indx] = status_flags[res];
+                slots[res]++;
+            }
 
             if (!ps_record->quiescing
                 && ps_record->pid) {
@@ -418,6 +464,92 @@ static int status_handler(request_rec *r)
                                ap_scoreboard_image->global->restart_time);
     ap_get_loadavg(&t);
 
+    if (metrics_report) {
+        ap_set_content_type(r, METRICS_CONTENT_TYPE);
+
+        ap_rputs("# TYPE apache info\n"
+                 "# HELP apache Server version and MPM\n", r);
+        ap_rprintf(r, "apache_info{version=\"%s\",mpm=\"%s\"} 1\n",
+                   metrics_label(r->pool, ap_get_server_description()),
+                   metrics_label(r->pool, ap_show_mpm()));
+        ap_rprintf(r, "# TYPE apache_uptime_seconds gauge\n"
+                      "apache_uptime_seconds %u\n", up_time);
+        ap_rprintf(r, "# TYPE apache_generation gauge\n"
+                      "apache_generation{type=\"config\"} %d\n"
+                      "apache_generation{type=\"mpm\"} %d\n",
+                   ap_state_query(AP_SQ_CONFIG_GEN), (int)mpm_generation);
+        ap_rprintf(r, "# TYPE apache_load gauge\n"
+                      "apache_load{interval=\"1m\"} %.2f\n"
+                      "apache_load{interval=\"5m\"} %.2f\n"
+                      "apache_load{interval=\"15m\"} %.2f\n",
+                   t.loadavg, t.loadavg5, t.loadavg15);
+
+        ap_rprintf(r, "# TYPE apache_workers gauge\n"
+                      "apache_workers{state=\"busy\"} %d\n"
+                      "apache_workers{state=\"graceful\"} %d\n"
+                      "apache_workers{state=\"idle\"} %d\n",
+                   busy, graceful, idle);
+        ap_rputs("# TYPE apache_scoreboard gauge\n"
+                 "# HELP apache_scoreboard Scoreboard slots by state\n", r);
+        for (i = 0; i < MOD_STATUS_NUM_STATUS; ++i) {
+            ap_rprintf(r, "apache_scoreboard{state=\"%s\"} %d\n",
+                       status_names[i], slots[i]);
+        }
+
+        if (is_async) {
+            int connections = 0, write_completion = 0, keep_alive = 0,
+                lingering_close = 0, stopping = 0, procs = 0;
+
+            for (i = 0; i < server_limit; ++i) {
+                ps_record = ap_get_scoreboard_process(i);
+                if (ps_record->pid) {
+                    connections      += ps_record->connections;
+                    write_completion += ps_record->write_completion;
+                    keep_alive       += ps_record->keep_alive;
+                    lingering_close  += ps_record->lingering_close;
+                    procs++;
+                    if (ps_record->quiescing) {
+                        stopping++;
+                    }
+                }
+            }
+            ap_rprintf(r, "# TYPE apache_processes gauge\n"
+                          "apache_processes{state=\"all\"} %d\n"
+                          "apache_processes{state=\"stopping\"} %d\n",
+                       procs, stopping);
+            ap_rprintf(r, "# TYPE apache_connections gauge\n"
+                          "apache_connections{state=\"all\"} %d\n"
+                          "apache_connections{state=\"writing\"} %d\n"
+                          "apache_connections{state=\"keepalive\"} %d\n"
+                          "apache_connections{state=\"closing\"} %d\n",
+                       connections, write_completion, keep_alive,
+                       lingering_close);
+        }
+
+        if (ap_extended_status) {
+            ap_rprintf(r, "# TYPE apache_requests counter\n"
+                          "apache_requests_total %lu\n", count);
+            ap_rprintf(r, "# TYPE apache_sent_bytes counter\n"
+                          "apache_sent_bytes_total %" APR_OFF_T_FMT "\n",
+                       kbcount * KBYTE + bcount);
+            ap_rprintf(r, "# TYPE apache_request_duration_seconds counter\n"
+                          "apache_request_duration_seconds_total %.6f\n",
+                       (double)duration_global / APR_USEC_PER_SEC);
+#ifdef HAVE_TIMES
+            ap_rprintf(r, "# TYPE apache_cpu_seconds counter\n"
+                          "apache_cpu_seconds_total{mode=\"user\"} %g\n"
+                          "apache_cpu_seconds_total{mode=\"system\"} %g\n"
+                          "apache_cpu_seconds_total{mode=\"children_user\"} %g\n"
+                          "apache_cpu_seconds_total{mode=\"children_system\"} %g\n",
+                       (gu + tu) / tick, (gs + ts) / tick,
+                       (gcu + tcu) / tick, (gcs + tcs) / tick);
+#endif
+        }
+
+        ap_rputs("# EOF\n", r);
+        return OK;
+    }
+
     if (!short_report) {
         ap_rputs(DOCTYPE_HTML_4_01
                  "<html><head>\n"
@@ -1009,6 +1141,18 @@ static int status_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp,
     status_flags[SERVER_GRACEFUL] = 'G';
     status_flags[SERVER_IDLE_KILL] = 'I';
     status_flags[SERVER_DISABLED] = ' ';
+    status_names[SERVER_DEAD] = "open";
+    status_names[SERVER_READY] = "waiting";
+    status_names[SERVER_STARTING] = "starting";
+    status_names[SERVER_BUSY_READ] = "reading";
+    status_names[SERVER_BUSY_WRITE] = "sending";
+    status_names[SERVER_BUSY_KEEPALIVE] = "keepalive";
+    status_names[SERVER_BUSY_LOG] = "logging";
+    status_names[SERVER_BUSY_DNS] = "dns";
+    status_names[SERVER_CLOSING] = "closing";
+    status_names[SERVER_GRACEFUL] = "graceful";
+    status_names[SERVER_IDLE_KILL] = "idle_cleanup";
+    status_names[SERVER_DISABLED] = "disabled";
     ap_mpm_query(AP_MPMQ_HARD_LIMIT_THREADS, &thread_limit);
     ap_mpm_query(AP_MPMQ_HARD_LIMIT_DAEMONS, &server_limit);
     ap_mpm_query(AP_MPMQ_MAX_THREADS, &threads_per_child);
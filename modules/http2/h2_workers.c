@@ -181,16 +181,34 @@ static void join_zombies(h2_workers *workers)
 static void wake_idle_worker(h2_workers *workers, ap_conn_producer_t *prod)
 {
     if (!APR_RING_EMPTY(&workers->idle, h2_slot, link)) {
-        h2_slot *slot;
-        for (slot = APR_RING_FIRST(&workers->idle);
+        h2_slot *slot, *dyn_slot = NULL;
+        /* Prefer a slot that belongs to the minimum set, those never
+         * time out. Otherwise pick the dynamic slot that went idle
+         * most recently (idle slots are appended at the tail).
+         * If we woke dynamic slots in FIFO order, any load above
+         * `min_active` would keep all of them busy just often enough
+         * to never reach their idle limit, and the number of threads
+         * would not shrink back to the actual work load. */
+        for (slot = APR_RING_LAST(&workers->idle);
              slot != APR_RING_SENTINEL(&workers->idle, h2_slot, link);
-             slot = APR_RING_NEXT(slot, link)) {
+             slot = APR_RING_PREV(slot, link)) {
              if (slot->is_idle && !slot->should_shutdown) {
-                apr_thread_cond_signal(slot->more_work);
-                slot->is_idle = 0;
-                return;
+                if (slot->id < workers->min_active) {
+                    break;
+                }
+                if (!dyn_slot) {
+                    dyn_slot = slot;
+                }
              }
         }
+        if (slot == APR_RING_SENTINEL(&workers->idle, h2_slot, link)) {
+            slot = dyn_slot;
+        }
+        if (slot) {
+            apr_thread_cond_signal(slot->more_work);
+            slot->is_idle = 0;
+            return;
+        }
     }
     if (workers->dynamic && !workers->shutdown
         && (workers->active_slots < workers->max_slots)) {
@@ -20,7 +20,9 @@
 /* Thread pool specific to executing secondary connections.
  * Has a minimum and maximum number of workers it creates.
  * Starts with minimum workers and adds some on load,
- * reduces the number again when idle.
+ * reduces the number again when idle. Idle workers beyond the minimum
+ * are woken most-recently-idle first, so that the number of threads
+ * follows the actual load and surplus ones reach their idle limit.
  */
 struct apr_thread_mutex_t;
 struct apr_thread_cond_t;
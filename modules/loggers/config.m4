@@ -34,15 +34,7 @@ APACHE_MODULE(syslog, logging to syslog, , , all, [
 ])
 
 
-APACHE_MODULE(log_json, logging in jsonn, , , most, [
-  APACHE_CHECK_JANSSON
-  if test "x$ac_cv_jansson" != "xyes" ; then
-      AC_MSG_WARN([libjansson not found])
-      enable_log_json="no"
-  else
-      APR_ADDTO(MOD_LOG_JSON_LDADD, [$ap_jansson_libs])
-  fi
-])
+APACHE_MODULE(log_json, logging in json, , , most)
 
 APACHE_MODULE(log_config, logging configuration.  You won't be able to log requests to the server without this module., , , yes)
 APACHE_MODULE(log_debug, configurable debug logging, , , most)
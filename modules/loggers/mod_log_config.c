@@ -151,6 +151,8 @@
 #include "apr_hash.h"
 #include "apr_optional.h"
 #include "apr_anylock.h"
+#include "apr_thread_proc.h"
+#include "apr_signal.h"
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -162,10 +164,13 @@
 #include "http_core.h"          /* For REMOTE_NAME */
 #include "http_log.h"
 #include "http_protocol.h"
+#include "http_request.h"
 #include "http_ssl.h"
 #include "util_time.h"
 #include "ap_mpm.h"
+#include "mpm_common.h"          /* For AP_SIG_GRACEFUL */
 #include "ap_provider.h"
+#include "scoreboard.h"
 
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>
@@ -205,6 +210,7 @@ static ap_log_writer *log_writer = ap_default_log_writer;
 static ap_log_writer_init *log_writer_init = ap_default_log_writer_init;
 static int buffered_logs = 0; /* default unbuffered */
 static apr_array_header_t *all_buffered_logs = NULL;
+static apr_array_header_t *all_rotating_logs = NULL;
 
 /* POSIX.1 defines PIPE_BUF as the maximum number of bytes that is
  * guaranteed to be atomic when writing a pipe.  And PIPE_BUF >= 512
@@ -255,12 +261,35 @@ typedef struct {
 
  */
 typedef struct {
-    apr_file_t *handle;
     apr_size_t outcnt;
     char outbuf[LOG_BUFSIZE];
+} log_buffer;
+
+/*
+ * buffered_log is the log_writer used with BufferedLogs. Worker threads
+ * of the MPM each fill their own buffer, which needs no locking. Requests
+ * of secondary connections (e.g. HTTP/2 streams) share the mutex protected
+ * buffer.
+ */
+typedef struct {
+    struct default_log_writer_t *handle;
+    log_buffer shared;
     apr_anylock_t mutex;
+    log_buffer *thread_bufs;
+    int thread_bufs_count;
 } buffered_log;
 
+/*
+ * log_rotation holds the rotate=, maxsize= and postrotate= options of
+ * a CustomLog. With rotate=, the file name may be a strftime() pattern
+ * which is expanded with the (GMT) start of the period.
+ */
+typedef struct {
+    apr_interval_time_t interval;
+    apr_off_t maxsize;
+    const char *postrotate;
+} log_rotation;
+
 typedef struct {
     const char *fname;
     const char *format_string;
@@ -271,6 +300,7 @@ typedef struct {
     ap_expr_info_t *condition_expr;
     /** place of definition or NULL if already checked */
     const ap_directive_t *directive;
+    log_rotation *rotation;
 } config_log_state;
 
 /*
@@ -289,6 +319,7 @@ typedef struct {
 typedef struct {
     ap_log_handler_fn_t *func;
     char *arg;
+    apr_size_t arglen;          /* strlen(arg) for constant items */
     int condition_sense;
     int want_orig;
     apr_array_header_t *conditions;
@@ -311,18 +342,21 @@ typedef struct {
  */
 enum default_log_writer_type {
     LOG_WRITER_FD,
-    LOG_WRITER_PROVIDER
+    LOG_WRITER_PROVIDER,
+    LOG_WRITER_ROTATE
 };
 
 /*
  * Abstract struct to allow multiple types of log writers to be created
  * by ap_default_log_writer_init function.
  */
-typedef struct {
+typedef struct default_log_writer_t {
     enum default_log_writer_type type;
     void *log_writer;
 } default_log_writer;
 
+static void *buffered_log_create(apr_pool_t *p, default_log_writer *handle);
+
 static char *pfmt(apr_pool_t *p, int i)
 {
     if (i <= 0) {
@@ -834,6 +868,22 @@ static const char *log_request_duration_scaled(request_rec *r, char *a)
     return apr_psprintf(r->pool, "%" APR_TIME_T_FMT, duration);
 }
 
+static const char *log_request_phase_time(request_rec *r, char *a)
+{
+    apr_interval_time_t t;
+    int phase = ap_request_phase_lookup(a);
+
+    if (phase < 0) {
+        /* bogus format */
+        return a;
+    }
+    t = ap_request_phase_time(r, phase);
+    if (t < 0) {
+        return NULL;
+    }
+    return apr_psprintf(r->pool, "%" APR_TIME_T_FMT, t);
+}
+
 /* These next two routines use the canonical name:port so that log
  * parsers don't need to duplicate all the vhost parsing crud.
  */
@@ -999,6 +1049,7 @@ static char *parse_log_misc_string(apr_pool_t *p, log_format_item *it,
         }
     }
     *d = '\0';
+    it->arglen = d - it->arg;
 
     *sa = s;
     return NULL;
@@ -1019,6 +1070,7 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
 
     if (*s == '%') {
         it->arg = "%";
+        it->arglen = 1;
         it->func = constant_item;
         *sa = ++s;
 
@@ -1027,6 +1079,7 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
 
     it->want_orig = -1;
     it->arg = "";               /* For safety's sake... */
+    it->arglen = 0;
 
     while (*s) {
         int i;
@@ -1107,6 +1160,34 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
     return "Ran off end of LogFormat parsing args to some directive";
 }
 
+/*
+ * Fold the item just pushed onto the array into its predecessor when
+ * both are constant strings, so that e.g. the "] \"" between %t and %r
+ * or a literal "%%" costs a single item at logging time.
+ */
+static void merge_constant_items(apr_pool_t *p, apr_array_header_t *a)
+{
+    log_format_item *items = (log_format_item *) a->elts;
+    log_format_item *prev, *last;
+    char *arg;
+
+    if (a->nelts < 2) {
+        return;
+    }
+    prev = &items[a->nelts - 2];
+    last = &items[a->nelts - 1];
+    if (prev->func != constant_item || last->func != constant_item) {
+        return;
+    }
+
+    arg = apr_palloc(p, prev->arglen + last->arglen + 1);
+    memcpy(arg, prev->arg, prev->arglen);
+    memcpy(arg + prev->arglen, last->arg, last->arglen + 1);
+    prev->arg = arg;
+    prev->arglen += last->arglen;
+    apr_array_pop(a);
+}
+
 static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const char **err)
 {
     apr_array_header_t *a = apr_array_make(p, 30, sizeof(log_format_item));
@@ -1117,10 +1198,12 @@ static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const
             *err = res;
             return NULL;
         }
+        merge_constant_items(p, a);
     }
 
     s = APR_EOL_STR;
     parse_log_item(p, (log_format_item *) apr_array_push(a), &s);
+    merge_constant_items(p, a);
     return a;
 }
 
@@ -1160,12 +1243,441 @@ static const char *process_item(request_rec *r, request_rec *orig,
     return cp ? cp : "-";
 }
 
-static void flush_log(buffered_log *buf)
+/*
+ * rotating_log is the log_writer of a CustomLog with rotation options.
+ * The file is opened by the parent and each child rotates it in process
+ * when writing to it, so no rotatelogs pipe is needed.
+ *
+ * Several children may want to rotate at the same time. The file is
+ * moved aside with a link+unlink, and each step is checked against the
+ * inode of the file we write to, so only one child moves a given file;
+ * the others (and the ones lagging behind) notice that the name now
+ * refers to another file, or the rotated name to ours, and simply
+ * reopen it. A strftime() pattern name needs no renaming, the child
+ * creating the next file is the one running the postrotate program on
+ * the previous one.
+ */
+typedef struct {
+    const log_rotation *conf;
+    const char *fname;          /* the configured name or pattern */
+    int pattern;                /* fname must be expanded with strftime() */
+    server_rec *s;
+    apr_pool_t *pool;           /* with its own allocator, under mutex */
+    apr_pool_t *fpool;          /* subpool of the current file */
+    apr_file_t *fd;
+    const char *path;           /* current file path */
+    apr_time_t period;          /* start of the current period */
+    apr_time_t next_check;      /* next check for foreign rotations */
+    apr_off_t unchecked;        /* bytes written since the last check */
+    apr_array_header_t *procs;  /* running postrotate helpers, to reap */
+    apr_anylock_t mutex;
+} rotating_log;
+
+/* Check the file for a rotation by another child at least this often
+ * (or after writing this many bytes when maxsize= is set).
+ */
+#define ROTATE_CHECK_INTERVAL apr_time_from_sec(1)
+#define ROTATE_CHECK_BYTES    (64 * 1024)
+
+/* Other children may append to a file moved aside for maxsize= until
+ * their next check, so postrotate runs only once they all have switched.
+ */
+#define ROTATE_POSTROTATE_DELAY (2 * ROTATE_CHECK_INTERVAL)
+
+static const char *rotating_log_path(rotating_log *rl, apr_pool_t *p,
+                                     apr_time_t period)
+{
+    const char *name = rl->fname;
+
+    if (rl->pattern) {
+        apr_time_exp_t xt;
+        apr_size_t len;
+        char buf[1024];
+
+        apr_time_exp_gmt(&xt, period);
+        if (apr_strftime(buf, &len, sizeof(buf), rl->fname, &xt) == APR_SUCCESS
+            && len) {
+            name = buf;
+        }
+    }
+    return ap_server_root_relative(p, name);
+}
+
+static void rotating_log_reap(rotating_log *rl)
+{
+    apr_proc_t *procs = (apr_proc_t *)rl->procs->elts;
+    apr_exit_why_e why;
+    int code, i = 0;
+
+    while (i < rl->procs->nelts) {
+        if (apr_proc_wait(&procs[i], &code, &why,
+                          APR_NOWAIT) != APR_CHILD_NOTDONE) {
+            procs[i] = procs[--rl->procs->nelts];
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+static void rotating_log_postrotate(rotating_log *rl, const char *rotated)
+{
+    apr_procattr_t *attr;
+    apr_proc_t proc;
+    apr_pool_t *p;
+    const char **argv;
+    char **args;
+    apr_status_t rv;
+    int i;
+
+    apr_pool_create(&p, rl->pool);
+    apr_pool_tag(p, "log_postrotate");
+
+    if ((rv = apr_tokenize_to_argv(rl->conf->postrotate, &args, p))
+            != APR_SUCCESS
+        || (rv = apr_procattr_create(&attr, p)) != APR_SUCCESS
+        || (rv = apr_procattr_cmdtype_set(attr, APR_PROGRAM_ENV))
+            != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, rl->s, APLOGNO(10461)
+                     "could not set up postrotate program for %s", rotated);
+        goto cleanup;
+    }
+    for (i = 0; args[i]; ++i)
+        ;
+    argv = apr_palloc(p, (i + 2) * sizeof(char *));
+    memcpy(argv, args, i * sizeof(char *));
+    argv[i] = rotated;
+    argv[i + 1] = NULL;
+
+    rv = apr_proc_create(&proc, argv[0], argv, NULL, attr, p);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, rl->s, APLOGNO(10462)
+                     "could not run postrotate program %s for %s",
+                     argv[0], rotated);
+        goto cleanup;
+    }
+    *(apr_proc_t *)apr_array_push(rl->procs) = proc;
+
+cleanup:
+    apr_pool_destroy(p);
+}
+
+/* Run postrotate once the other children have switched files. A helper
+ * process waits for them, so the program also runs when this child goes
+ * idle or exits in the meantime.
+ */
+static void rotating_log_defer_postrotate(rotating_log *rl,
+                                          const char *rotated)
+{
+#if APR_HAS_FORK
+    apr_proc_t proc;
+    apr_status_t rv;
+
+    rv = apr_proc_fork(&proc, rl->pool);
+    if (rv == APR_INCHILD) {
+        /* Survive the signals sent to the children's process group on
+         * stop and restart, but don't pass that on to the program.
+         */
+        apr_signal(SIGTERM, SIG_IGN);
+        apr_signal(SIGHUP, SIG_IGN);
+        apr_signal(AP_SIG_GRACEFUL, SIG_IGN);
+        apr_signal(AP_SIG_GRACEFUL_STOP, SIG_IGN);
+        apr_sleep(ROTATE_POSTROTATE_DELAY);
+        apr_signal(SIGTERM, SIG_DFL);
+        apr_signal(SIGHUP, SIG_DFL);
+        apr_signal(AP_SIG_GRACEFUL, SIG_DFL);
+        apr_signal(AP_SIG_GRACEFUL_STOP, SIG_DFL);
+
+        /* We are the only thread here, and the log's pool is only used
+         * under the mutex held by the thread that forked us.
+         */
+        rotating_log_postrotate(rl, rotated);
+        exit(0);
+    }
+    if (rv == APR_INPARENT) {
+        *(apr_proc_t *)apr_array_push(rl->procs) = proc;
+        return;
+    }
+    ap_log_error(APLOG_MARK, APLOG_WARNING, rv, rl->s, APLOGNO(10490)
+                 "could not fork to delay the postrotate program for %s, "
+                 "running it now", rotated);
+#endif
+    rotating_log_postrotate(rl, rotated);
+}
+
+/* Whether path refers to the file we write to, and its size */
+static int rotating_log_is_ours(rotating_log *rl, const char *path,
+                                apr_off_t *size, apr_pool_t *p)
+{
+    apr_finfo_t ours, cur;
+    apr_status_t rv;
+
+    rv = apr_file_info_get(&ours, APR_FINFO_IDENT, rl->fd);
+    if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+        return 0;
+    }
+    rv = apr_stat(&cur, path, APR_FINFO_IDENT | APR_FINFO_SIZE, p);
+    if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+        return 0;
+    }
+    if (size) {
+        *size = cur.size;
+    }
+    return (ours.valid & cur.valid & APR_FINFO_IDENT) == APR_FINFO_IDENT
+           && ours.inode == cur.inode && ours.device == cur.device;
+}
+
+/* Switch to the file at path, opening it exclusively first to tell
+ * whether this child is the one creating it (when *created != NULL).
+ */
+static apr_status_t rotating_log_open(rotating_log *rl, apr_pool_t *fpool,
+                                      const char *path, int *created)
+{
+    apr_file_t *fd;
+    apr_status_t rv = APR_EEXIST;
+
+    if (created) {
+        *created = 0;
+        rv = apr_file_open(&fd, path, xfer_flags | APR_EXCL, xfer_perms,
+                           fpool);
+        if (rv == APR_SUCCESS) {
+            *created = 1;
+        }
+    }
+    if (APR_STATUS_IS_EEXIST(rv)) {
+        rv = apr_file_open(&fd, path, xfer_flags, xfer_perms, fpool);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, rl->s, APLOGNO(10463)
+                     "could not open rotated transfer log file %s", path);
+        apr_pool_destroy(fpool);
+        return rv;
+    }
+
+    if (rl->fpool) {
+        apr_pool_destroy(rl->fpool);
+    }
+    rl->fpool = fpool;
+    rl->fd = fd;
+    rl->path = path;
+    rl->unchecked = 0;
+    return APR_SUCCESS;
+}
+
+/* Rotate the current file: move it aside with the given time stamp
+ * (unless another child already did, or it is smaller than minsize
+ * by now) and continue with a new one.
+ */
+static void rotating_log_rotate(rotating_log *rl, apr_time_t stamp_time,
+                                apr_time_t period, apr_off_t minsize)
+{
+    apr_pool_t *fpool;
+    const char *path, *name, *rotated = NULL;
+    char stamp[APR_RFC822_DATE_LEN];
+    apr_time_exp_t xt;
+    apr_size_t len;
+    apr_off_t size;
+    apr_status_t rv;
+    int created, seq;
+
+    if (rl->procs->nelts) {
+        rotating_log_reap(rl);
+    }
+
+    apr_pool_create(&fpool, rl->pool);
+    apr_pool_tag(fpool, "log_rotate");
+
+    path = rotating_log_path(rl, fpool, period);
+    if (!path) {
+        apr_pool_destroy(fpool);
+        return;
+    }
+
+    if (!rl->pattern || !strcmp(path, rl->path)) {
+        /* Same name, move the current file aside, unless the name
+         * refers to another file already. The link() fails if another
+         * child already did it with the same stamp, then the stamped
+         * name refers to our file. If it refers to another file, an
+         * earlier rotation in the same second took the name and we add
+         * a sequence number.
+         */
+        if (rotating_log_is_ours(rl, rl->path, &size, fpool)
+            && size >= minsize) {
+            apr_time_exp_gmt(&xt, stamp_time);
+            apr_strftime(stamp, &len, sizeof(stamp), "%Y%m%d%H%M%S", &xt);
+            name = apr_pstrcat(fpool, rl->path, ".", stamp, NULL);
+            for (seq = 1; seq <= 100; ++seq) {
+                rv = apr_file_link(rl->path, name);
+                if (rv == APR_SUCCESS) {
+                    rotated = name;
+                    break;
+                }
+                if (!APR_STATUS_IS_EEXIST(rv)
+                    || rotating_log_is_ours(rl, name, NULL, fpool)) {
+                    break;
+                }
+                name = apr_psprintf(fpool, "%s.%s.%d", rl->path, stamp, seq);
+            }
+        }
+        /* Between the checks and the link(), another child may have
+         * replaced the file (our link then refers to its new file), or
+         * moved our file aside under another stamp. Keep only one name
+         * for our file, and let the child owning it run postrotate.
+         */
+        if (rotated
+            && (!rotating_log_is_ours(rl, rotated, NULL, fpool)
+                || !rotating_log_is_ours(rl, rl->path, NULL, fpool)
+                || apr_file_remove(rl->path, fpool) != APR_SUCCESS)) {
+            apr_file_remove(rotated, fpool);
+            rotated = NULL;
+        }
+        rv = rotating_log_open(rl, fpool, path, NULL);
+    }
+    else {
+        /* New name, the child creating the file rotated the previous */
+        rotated = apr_pstrdup(fpool, rl->path);
+        rv = rotating_log_open(rl, fpool, path, &created);
+        if (!created) {
+            rotated = NULL;
+        }
+    }
+    /* Don't retry on every write if the new file can't be opened */
+    rl->period = period;
+
+    if (rv == APR_SUCCESS && rotated && rl->conf->postrotate) {
+        rotating_log_defer_postrotate(rl, rotated);
+    }
+}
+
+/* Reopen the file if another child rotated it, or rotate it if it
+ * grew beyond maxsize.
+ */
+static void rotating_log_check(rotating_log *rl, apr_time_t now)
+{
+    apr_finfo_t ours, cur;
+    apr_status_t rv;
+
+    rl->next_check = now + ROTATE_CHECK_INTERVAL;
+    rl->unchecked = 0;
+    if (rl->procs->nelts) {
+        rotating_log_reap(rl);
+    }
+
+    rv = apr_file_info_get(&ours, APR_FINFO_SIZE | APR_FINFO_IDENT, rl->fd);
+    if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+        return;
+    }
+    rv = apr_stat(&cur, rl->path, APR_FINFO_IDENT, rl->fpool);
+    if ((rv != APR_SUCCESS && rv != APR_INCOMPLETE)
+        || ((ours.valid & cur.valid & APR_FINFO_IDENT) == APR_FINFO_IDENT
+            && (ours.inode != cur.inode || ours.device != cur.device))) {
+        apr_pool_t *fpool;
+
+        apr_pool_create(&fpool, rl->pool);
+        apr_pool_tag(fpool, "log_rotate");
+        rotating_log_open(rl, fpool, rl->path, NULL);
+    }
+    else if (rl->conf->maxsize && ours.size >= rl->conf->maxsize) {
+        rotating_log_rotate(rl, now, rl->period, rl->conf->maxsize);
+    }
+}
+
+static apr_status_t rotating_log_write(rotating_log *rl, const char *str,
+                                       apr_size_t len)
 {
-    if (buf->outcnt && buf->handle != NULL) {
+    apr_time_t now = apr_time_now();
+    apr_status_t rv;
+
+    if ((rv = APR_ANYLOCK_LOCK(&rl->mutex)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (rl->conf->interval && now >= rl->period + rl->conf->interval) {
+        /* Stamped with the period being closed, so that the children
+         * lagging behind don't rotate the new file again.
+         */
+        rotating_log_rotate(rl, rl->period, now - now % rl->conf->interval,
+                            0);
+    }
+    else if ((!rl->pattern || rl->conf->maxsize)
+             && (now >= rl->next_check
+                 || (rl->conf->maxsize
+                     && rl->unchecked >= ROTATE_CHECK_BYTES))) {
+        rotating_log_check(rl, now);
+    }
+
+    rv = apr_file_write_full(rl->fd, str, len, NULL);
+    rl->unchecked += len;
+
+    APR_ANYLOCK_UNLOCK(&rl->mutex);
+    return rv;
+}
+
+static default_log_writer *rotating_log_init(apr_pool_t *p, server_rec *s,
+                                             const char *name,
+                                             const log_rotation *conf)
+{
+    default_log_writer *log_writer;
+    apr_allocator_t *allocator;
+    apr_pool_t *fpool;
+    rotating_log *rl;
+    apr_time_t now = apr_time_now();
+
+    rl = apr_pcalloc(p, sizeof(*rl));
+    rl->conf = conf;
+    rl->fname = name;
+    rl->pattern = conf->interval && ap_strchr_c(name, '%') != NULL;
+    rl->s = s;
+    rl->mutex.type = apr_anylock_none;
+    if (conf->interval) {
+        rl->period = now - now % conf->interval;
+    }
+    rl->next_check = now + ROTATE_CHECK_INTERVAL;
+
+    /* The children rotate from any worker thread, so give the files
+     * their own allocator protected by the log's mutex.
+     */
+    apr_allocator_create(&allocator);
+    apr_pool_create_ex(&rl->pool, p, NULL, allocator);
+    apr_allocator_owner_set(allocator, rl->pool);
+    apr_pool_tag(rl->pool, "log_rotate");
+    rl->procs = apr_array_make(rl->pool, 2, sizeof(apr_proc_t));
+    apr_pool_create(&fpool, rl->pool);
+
+    rl->path = rotating_log_path(rl, fpool, rl->period);
+    if (!rl->path) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_EBADPATH, s, APLOGNO(10464)
+                     "invalid transfer log path %s.", name);
+        return NULL;
+    }
+    if (rotating_log_open(rl, fpool, rl->path, NULL) != APR_SUCCESS) {
+        return NULL;
+    }
+
+    *(rotating_log **)apr_array_push(all_rotating_logs) = rl;
+
+    log_writer = apr_pcalloc(p, sizeof(default_log_writer));
+    log_writer->type = LOG_WRITER_ROTATE;
+    log_writer->log_writer = rl;
+    return log_writer;
+}
+
+static apr_status_t log_writer_write(default_log_writer *log_writer,
+                                     const char *str, apr_size_t len)
+{
+    if (log_writer->type == LOG_WRITER_ROTATE) {
+        return rotating_log_write(log_writer->log_writer, str, len);
+    }
+    return apr_file_write_full((apr_file_t *)log_writer->log_writer,
+                               str, len, NULL);
+}
+
+static void flush_log(buffered_log *buf, log_buffer *lb)
+{
+    if (lb->outcnt && buf->handle != NULL) {
         /* XXX: error handling */
-        apr_file_write_full(buf->handle, buf->outbuf, buf->outcnt, NULL);
-        buf->outcnt = 0;
+        log_writer_write(buf->handle, lb->outbuf, lb->outcnt);
+        lb->outcnt = 0;
     }
 }
 
@@ -1229,6 +1741,12 @@ static int config_log_transaction(request_rec *r, config_log_state *cls,
     }
 
     for (i = 0; i < format->nelts; ++i) {
+        if (items[i].func == constant_item) {
+            /* length known since parse time, no need to call or scan */
+            strs[i] = items[i].arg;
+            len += strl[i] = items[i].arglen;
+            continue;
+        }
         strs[i] = process_item(r, orig, &items[i]);
         len += strl[i] = strlen(strs[i]);
     }
@@ -1403,8 +1921,104 @@ static const char *add_custom_log(cmd_parms *cmd, void *dummy, const char *fn,
     return err_string;
 }
 
-static const char *add_global_log(cmd_parms *cmd, void *dummy, const char *fn,
-                                  const char *fmt, const char *envclause) {
+/* Parse a rotation option into rot, *found tells whether arg is one */
+static const char *parse_log_rotation(log_rotation *rot, const char *arg,
+                                      int *found)
+{
+    *found = 1;
+    if (strncasecmp(arg, "rotate=", 7) == 0) {
+        if (ap_timeout_parameter_parse(arg + 7, &rot->interval, "s")
+                != APR_SUCCESS
+            || rot->interval < apr_time_from_sec(1)) {
+            return "rotate= needs an interval of at least one second";
+        }
+    }
+    else if (strncasecmp(arg, "maxsize=", 8) == 0) {
+        char *end;
+
+        if (apr_strtoff(&rot->maxsize, arg + 8, &end, 10) != APR_SUCCESS
+            || rot->maxsize <= 0) {
+            return "maxsize= needs a positive size";
+        }
+        switch (apr_toupper(*end)) {
+        case 'G':
+            rot->maxsize *= 1024;
+            /* fall through */
+        case 'M':
+            rot->maxsize *= 1024;
+            /* fall through */
+        case 'K':
+            rot->maxsize *= 1024;
+            ++end;
+            break;
+        }
+        if (*end) {
+            return "maxsize= needs a size in bytes, or with a K, M or G unit";
+        }
+    }
+    else if (strncasecmp(arg, "postrotate=", 11) == 0) {
+        if (arg[11] == '\0') {
+            return "postrotate= needs a program";
+        }
+        rot->postrotate = arg + 11;
+    }
+    else {
+        *found = 0;
+    }
+    return NULL;
+}
+
+/* CustomLog file format [env=...|expr=...] [rotate=...] [maxsize=...]
+ *                       [postrotate=...]
+ */
+static const char *add_custom_log_argv(cmd_parms *cmd, void *dummy,
+                                       int argc, char *const argv[])
+{
+    multi_log_state *mls = ap_get_module_config(cmd->server->module_config,
+                                                &log_config_module);
+    const char *envclause = NULL;
+    log_rotation rot = { 0 }, *rotation = NULL;
+    const char *err;
+    int i, found;
+
+    if (argc < 2) {
+        return apr_pstrcat(cmd->pool, cmd->cmd->name,
+                           " needs a file name and a log format", NULL);
+    }
+    for (i = 2; i < argc; ++i) {
+        if ((err = parse_log_rotation(&rot, argv[i], &found))) {
+            return err;
+        }
+        if (found) {
+            rotation = &rot;
+        }
+        else if (!envclause) {
+            envclause = argv[i];
+        }
+        else {
+            return "only one \"env=\" or \"expr=\" clause is allowed";
+        }
+    }
+    if (rotation) {
+        if (*argv[0] == '|') {
+            return "log rotation is not available for piped logs";
+        }
+        if (!rot.interval && !rot.maxsize) {
+            return "postrotate= needs rotate= or maxsize=";
+        }
+    }
+
+    err = add_custom_log(cmd, dummy, argv[0], argv[1], envclause);
+    if (err == NULL && rotation) {
+        config_log_state *cls = &((config_log_state *)mls->config_logs->elts)
+                                    [mls->config_logs->nelts - 1];
+        cls->rotation = apr_pmemdup(cmd->pool, &rot, sizeof(rot));
+    }
+    return err;
+}
+
+static const char *add_global_log(cmd_parms *cmd, void *dummy,
+                                  int argc, char *const argv[]) {
     multi_log_state *mls = ap_get_module_config(cmd->server->module_config,
                                                 &log_config_module);
     config_log_state *clsarray;
@@ -1418,7 +2032,7 @@ static const char *add_global_log(cmd_parms *cmd, void *dummy, const char *fn,
     }
 
     /* Add a custom log through the normal channel */
-    ret = add_custom_log(cmd, dummy, fn, fmt, envclause);
+    ret = add_custom_log_argv(cmd, dummy, argc, argv);
 
     /* Set the inherit flag unless there was some error */
     if (ret == NULL) {
@@ -1451,10 +2065,11 @@ static const char *set_buffered_logs_on(cmd_parms *parms, void *dummy, int flag)
 }
 static const command_rec config_log_cmds[] =
 {
-AP_INIT_TAKE23("CustomLog", add_custom_log, NULL, RSRC_CONF,
+AP_INIT_TAKE_ARGV("CustomLog", add_custom_log_argv, NULL, RSRC_CONF,
      "a file name, a custom log format string or format name, "
-     "and an optional \"env=\" or \"expr=\" clause (see docs)"),
-AP_INIT_TAKE23("GlobalLog", add_global_log, NULL, RSRC_CONF,
+     "an optional \"env=\" or \"expr=\" clause and optional rotate=, "
+     "maxsize= and postrotate= options (see docs)"),
+AP_INIT_TAKE_ARGV("GlobalLog", add_global_log, NULL, RSRC_CONF,
      "Same as CustomLog, but forces virtualhosts to inherit the log"),
 AP_INIT_TAKE1("TransferLog", set_transfer_log, NULL, RSRC_CONF,
      "the filename of the access log"),
@@ -1477,7 +2092,23 @@ static config_log_state *open_config_log(server_rec *s, apr_pool_t *p,
         return cls;             /* Leave it NULL to decline.  */
     }
 
-    cls->log_writer = log_writer_init(p, s, cls->fname);
+    if (cls->rotation) {
+        /* Rotation is implemented by our own log writers only */
+        if (log_writer_init != ap_default_log_writer_init
+            && log_writer_init != ap_buffered_log_writer_init) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(10465)
+                         "log rotation of %s is not supported by the "
+                         "configured log writer", cls->fname);
+            return NULL;
+        }
+        cls->log_writer = rotating_log_init(p, s, cls->fname, cls->rotation);
+        if (cls->log_writer && buffered_logs) {
+            cls->log_writer = buffered_log_create(p, cls->log_writer);
+        }
+    }
+    else {
+        cls->log_writer = log_writer_init(p, s, cls->fname);
+    }
     if (cls->log_writer == NULL)
         return NULL;
 
@@ -1547,32 +2178,21 @@ static int open_multi_logs(server_rec *s, apr_pool_t *p)
 
 static apr_status_t flush_all_logs(void *data)
 {
-    server_rec *s = data;
-    multi_log_state *mls;
-    apr_array_header_t *log_list;
-    config_log_state *clsarray;
-    buffered_log *buf;
-    int i;
+    buffered_log **array;
+    int i, j;
 
     if (!buffered_logs)
         return APR_SUCCESS;
 
-    for (; s; s = s->next) {
-        mls = ap_get_module_config(s->module_config, &log_config_module);
-        log_list = NULL;
-        if (mls->config_logs->nelts) {
-            log_list = mls->config_logs;
-        }
-        else if (mls->server_config_logs) {
-            log_list = mls->server_config_logs;
-        }
-        if (log_list) {
-            clsarray = (config_log_state *) log_list->elts;
-            for (i = 0; i < log_list->nelts; ++i) {
-                buf = clsarray[i].log_writer;
-                flush_log(buf);
-            }
+    /* Called on child exit, when the worker threads are gone. */
+    array = (buffered_log **)all_buffered_logs->elts;
+    for (i = 0; i < all_buffered_logs->nelts; i++) {
+        buffered_log *buf = array[i];
+
+        for (j = 0; j < buf->thread_bufs_count; j++) {
+            flush_log(buf, &buf->thread_bufs[j]);
         }
+        flush_log(buf, &buf->shared);
     }
     return APR_SUCCESS;
 }
@@ -1586,6 +2206,7 @@ static int init_config_log(apr_pool_t *pc, apr_pool_t *p, apr_pool_t *pt, server
     if (buffered_logs) {
         all_buffered_logs = apr_array_make(p, 5, sizeof(buffered_log *));
     }
+    all_rotating_logs = apr_array_make(p, 2, sizeof(rotating_log *));
 
     /* Next, do "physical" server, which gets default log fd and format
      * for the virtual servers, if they don't override...
@@ -1607,6 +2228,29 @@ static void init_child(apr_pool_t *p, server_rec *s)
 
     ap_mpm_query(AP_MPMQ_MAX_THREADS, &mpm_threads);
 
+#if APR_HAS_THREADS
+    /* The worker threads of a child share the rotating logs */
+    if (mpm_threads > 1 && all_rotating_logs) {
+        int i;
+        rotating_log **array = (rotating_log **)all_rotating_logs->elts;
+
+        for (i = 0; i < all_rotating_logs->nelts; i++) {
+            rotating_log *rl = array[i];
+            apr_status_t rv;
+
+            rl->mutex.type = apr_anylock_threadmutex;
+            rv = apr_thread_mutex_create(&rl->mutex.lock.tm,
+                                         APR_THREAD_MUTEX_DEFAULT, p);
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10466)
+                             "could not initialize rotating log mutex, "
+                             "transfer log may become corrupted");
+                rl->mutex.type = apr_anylock_none;
+            }
+        }
+    }
+#endif
+
     /* Now register the last buffer flush with the cleanup engine */
     if (buffered_logs) {
         int i;
@@ -1621,6 +2265,12 @@ static void init_child(apr_pool_t *p, server_rec *s)
             if (mpm_threads > 1) {
                 apr_status_t rv;
 
+                if (this->handle->type != LOG_WRITER_PROVIDER) {
+                    this->thread_bufs = apr_pcalloc(p, mpm_threads
+                                                       * sizeof(log_buffer));
+                    this->thread_bufs_count = mpm_threads;
+                }
+
                 this->mutex.type = apr_anylock_threadmutex;
                 rv = apr_thread_mutex_create(&this->mutex.lock.tm,
                                              APR_THREAD_MUTEX_DEFAULT,
@@ -1691,9 +2341,8 @@ static apr_status_t ap_default_log_writer( request_rec *r,
         s += strl[i];
     }
 
-    if (log_writer->type == LOG_WRITER_FD) {
-        rv = apr_file_write_full((apr_file_t*)log_writer->log_writer, str,
-                                 len, NULL);
+    if (log_writer->type != LOG_WRITER_PROVIDER) {
+        rv = log_writer_write(log_writer, str, len);
     }
     else {
         errorlog_provider_data *data = log_writer->log_writer;
@@ -1788,40 +2437,38 @@ static void *ap_default_log_writer_init(apr_pool_t *p, server_rec *s,
         return log_writer;
     }
 }
-static void *ap_buffered_log_writer_init(apr_pool_t *p, server_rec *s,
-                                        const char* name)
+static void *buffered_log_create(apr_pool_t *p, default_log_writer *handle)
 {
     buffered_log *b;
-    b = apr_pcalloc(p, sizeof(buffered_log));
-    b->handle = ap_default_log_writer_init(p, s, name);
 
-    if (b->handle) {
-        *(buffered_log **)apr_array_push(all_buffered_logs) = b;
-        return b;
-    }
-    else
+    if (!handle) {
         return NULL;
+    }
+    b = apr_pcalloc(p, sizeof(buffered_log));
+    b->handle = handle;
+    *(buffered_log **)apr_array_push(all_buffered_logs) = b;
+    return b;
 }
-static apr_status_t ap_buffered_log_writer(request_rec *r,
-                                           void *handle,
-                                           const char **strs,
-                                           int *strl,
-                                           int nelts,
-                                           apr_size_t len)
-
+static void *ap_buffered_log_writer_init(apr_pool_t *p, server_rec *s,
+                                        const char* name)
+{
+    return buffered_log_create(p, ap_default_log_writer_init(p, s, name));
+}
+static apr_status_t buffer_log_line(request_rec *r,
+                                    buffered_log *buf,
+                                    log_buffer *lb,
+                                    const char **strs,
+                                    int *strl,
+                                    int nelts,
+                                    apr_size_t len)
 {
     char *str;
     char *s;
     int i;
     apr_status_t rv;
-    buffered_log *buf = (buffered_log*)handle;
-
-    if ((rv = APR_ANYLOCK_LOCK(&buf->mutex)) != APR_SUCCESS) {
-        return rv;
-    }
 
-    if (len + buf->outcnt > LOG_BUFSIZE) {
-        flush_log(buf);
+    if (len + lb->outcnt > LOG_BUFSIZE) {
+        flush_log(buf, lb);
     }
     if (len >= LOG_BUFSIZE) {
         apr_size_t w;
@@ -1836,18 +2483,57 @@ static apr_status_t ap_buffered_log_writer(request_rec *r,
             s += strl[i];
         }
         w = len;
-        rv = apr_file_write_full(buf->handle, str, w, NULL);
+        rv = log_writer_write(buf->handle, str, w);
 
     }
     else {
-        for (i = 0, s = &buf->outbuf[buf->outcnt]; i < nelts; ++i) {
+        for (i = 0, s = &lb->outbuf[lb->outcnt]; i < nelts; ++i) {
             memcpy(s, strs[i], strl[i]);
             s += strl[i];
         }
-        buf->outcnt += len;
+        lb->outcnt += len;
         rv = APR_SUCCESS;
     }
 
+    return rv;
+}
+
+static apr_status_t ap_buffered_log_writer(request_rec *r,
+                                           void *handle,
+                                           const char **strs,
+                                           int *strl,
+                                           int nelts,
+                                           apr_size_t len)
+
+{
+    apr_status_t rv;
+    buffered_log *buf = (buffered_log*)handle;
+
+    /* Error log providers do their own thing */
+    if (buf->handle->type == LOG_WRITER_PROVIDER) {
+        return ap_default_log_writer(r, buf->handle, strs, strl, nelts, len);
+    }
+
+    /* The scoreboard handle of the connection belongs to the worker
+     * thread that currently runs it, so its buffer is ours alone.
+     * Secondary connections carry the handle of their master, but may
+     * be logged from any worker (e.g. when HTTP/2 destroys the stream's
+     * EOR bucket), so they must take the lock.
+     */
+    if (buf->thread_bufs && r->connection->sbh && !r->connection->master) {
+        int child_num, thread_num;
+
+        ap_sb_get_child_thread(r->connection->sbh, &child_num, &thread_num);
+        if (thread_num >= 0 && thread_num < buf->thread_bufs_count) {
+            return buffer_log_line(r, buf, &buf->thread_bufs[thread_num],
+                                   strs, strl, nelts, len);
+        }
+    }
+
+    if ((rv = APR_ANYLOCK_LOCK(&buf->mutex)) != APR_SUCCESS) {
+        return rv;
+    }
+    rv = buffer_log_line(r, buf, &buf->shared, strs, strl, nelts, len);
     APR_ANYLOCK_UNLOCK(&buf->mutex);
     return rv;
 }
@@ -1893,6 +2579,7 @@ static int log_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
 
         log_pfn_register(p, "^ti", log_trailer_in, 0);
         log_pfn_register(p, "^to", log_trailer_out, 0);
+        log_pfn_register(p, "^pt", log_request_phase_time, 0);
 
         /* these used to be part of mod_ssl, but with the introduction
          * of ap_ssl_var_lookup() they are added here directly so lookups
@@ -26,143 +26,174 @@
 
 #include "apr_strings.h"
 
-/* jansson thinks everyone compiles with the platform's cc in its fullest capabilities
- * when undefining their INLINEs, we get static, unused functions, arg 
- */
-#if defined(__GNUC__)
-#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)
-#pragma GCC diagnostic push
-#endif
-#pragma GCC diagnostic ignored "-Wunused-function"
-#pragma GCC diagnostic ignored "-Wunreachable-code"
-#elif defined(__clang__)
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-function"
-#endif
-
-#include <jansson_config.h>
-#undef  JSON_INLINE
-#define JSON_INLINE
-#include <jansson.h>
-
 APLOG_USE_MODULE(log_json);
 
 module AP_MODULE_DECLARE_DATA log_json_module;
 
 static APR_OPTIONAL_FN_TYPE(ap_register_log_handler) *log_json_register = NULL;
 
-static const char *crit_error =
-    "{\"mod_log_json_error\": \"critical error during serialization: see error "
-    "log\"}";
+/*
+ * The record is serialized in two passes over the same values: the
+ * first one with out == NULL only sums up the length, the second one
+ * writes into a buffer allocated once with exactly that size. This
+ * avoids building an intermediate document tree per logged request.
+ */
+typedef struct {
+    char *out;
+    apr_size_t len;
+    int first;
+} log_json_writer;
+
+typedef struct {
+    const char *log_id;
+    const char *vhost;
+    const char *status;
+    const char *proto;
+    const char *method;
+    const char *uri;
+    const char *srcip;
+    const char *bytes_sent;
+    const char *user;
+    const char *user_agent;
+    int is_ssl;
+    const char *tls_v;
+    const char *tls_cipher;
+    const char *tls_client_verify;
+    const char *tls_sni;
+} log_json_record;
+
+static void json_raw(log_json_writer *w, const char *s, apr_size_t len)
+{
+    if (w->out) {
+        memcpy(w->out + w->len, s, len);
+    }
+    w->len += len;
+}
 
-static int
-log_json_dump_bb(const char *buffer, size_t size, void *baton)
+static void json_string(log_json_writer *w, const char *s)
 {
-    apr_bucket_brigade *bb = baton;
-    apr_brigade_write(bb, NULL, NULL, buffer, size);
-    return 0;
+    json_raw(w, "\"", 1);
+    w->len += ap_escape_json(w->out ? w->out + w->len : NULL, s);
+    json_raw(w, "\"", 1);
 }
 
-static const char *
-log_json(request_rec *r, char *a)
+static void json_key(log_json_writer *w, const char *key)
 {
-    apr_size_t olen;
-    apr_status_t rv;
-    int err;
-    char *out;
-    apr_bucket_brigade *bb;
-    json_t *obj;
-    json_t *hdrs;
-
-    obj = json_object();
-
-    json_object_set_new_nocheck(obj, "log_id",
-        r->log_id != NULL ? json_string(r->log_id) : json_null());
-    json_object_set_new_nocheck(
-        obj, "vhost", json_string(r->server->server_hostname));
-    json_object_set_new_nocheck(
-        obj, "status", json_string(apr_itoa(r->pool, r->status)));
-    json_object_set_new_nocheck(obj, "proto", json_string(r->protocol));
-    json_object_set_new_nocheck(obj, "method", json_string(r->method));
-    json_object_set_new_nocheck(obj, "uri", json_string(r->uri));
-    json_object_set_new_nocheck(obj, "srcip", json_string(r->useragent_ip));
-    json_object_set_new_nocheck(obj, "bytes_sent", json_integer(r->bytes_sent));
-
-    if (r->user != NULL) {
-        json_object_set_new_nocheck(obj, "user", json_string(r->user));
+    if (!w->first) {
+        json_raw(w, ",", 1);
     }
+    w->first = 0;
+    /* keys are literals in this file and never need escaping */
+    json_raw(w, "\"", 1);
+    json_raw(w, key, strlen(key));
+    json_raw(w, "\":", 2);
+}
 
-    hdrs = json_object();
-    json_object_set_new_nocheck(hdrs, "user-agent",
-        json_string(apr_table_get(r->headers_in, "User-Agent")));
-    json_object_set_new_nocheck(obj, "hdrs", hdrs);
-
-    if (ap_ssl_conn_is_ssl(r->connection)) {
-        json_t *tls = json_object();
-
-        json_object_set_new_nocheck(tls, "v",
-            json_string(ap_ssl_var_lookup(
-                r->pool, r->server, r->connection, r, "SSL_PROTOCOL")));
-        json_object_set_new_nocheck(tls, "cipher",
-            json_string(ap_ssl_var_lookup(
-                r->pool, r->server, r->connection, r, "SSL_CIPHER")));
-        json_object_set_new_nocheck(tls, "client_verify",
-            json_string(ap_ssl_var_lookup(
-                r->pool, r->server, r->connection, r, "SSL_CLIENT_VERIFY")));
-        json_object_set_new_nocheck(tls, "sni",
-            json_string(ap_ssl_var_lookup(
-                r->pool, r->server, r->connection, r, "SSL_TLS_SNI")));
-
-        json_object_set_new_nocheck(obj, "tls", tls);
+/* Members with a NULL value are left out of the record. */
+static void json_member(log_json_writer *w, const char *key, const char *val)
+{
+    if (val != NULL) {
+        json_key(w, key);
+        json_string(w, val);
     }
+}
 
-    bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-    err = json_dump_callback(
-        obj, log_json_dump_bb, bb, JSON_ENSURE_ASCII | JSON_COMPACT);
-    if (err != 0) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
-            APLOGNO(10125) "json_dump_callback failed: %d", err);
-        apr_brigade_destroy(bb);
-        return crit_error;
-    }
+static void json_open(log_json_writer *w)
+{
+    json_raw(w, "{", 1);
+    w->first = 1;
+}
 
-    rv = apr_brigade_pflatten(bb, &out, &olen, r->pool);
-    if (rv != APR_SUCCESS) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
-            APLOGNO(10126) "apr_brigade_pflatten failed");
-        apr_brigade_destroy(bb);
-        return crit_error;
-    }
-    apr_brigade_destroy(bb);
-    return out;
+static void json_close(log_json_writer *w)
+{
+    json_raw(w, "}", 1);
+    w->first = 0;
 }
 
-static int
-log_json_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
+static void log_json_write(log_json_writer *w, const log_json_record *rec)
 {
-    log_json_register = APR_RETRIEVE_OPTIONAL_FN(ap_register_log_handler);
-    log_json_register(p, "^JS", log_json, 0);
-    return OK;
+    json_open(w);
+
+    json_key(w, "log_id");
+    if (rec->log_id != NULL) {
+        json_string(w, rec->log_id);
+    }
+    else {
+        json_raw(w, "null", 4);
+    }
+    json_member(w, "vhost", rec->vhost);
+    json_member(w, "status", rec->status);
+    json_member(w, "proto", rec->proto);
+    json_member(w, "method", rec->method);
+    json_member(w, "uri", rec->uri);
+    json_member(w, "srcip", rec->srcip);
+    json_key(w, "bytes_sent");
+    json_raw(w, rec->bytes_sent, strlen(rec->bytes_sent));
+    json_member(w, "user", rec->user);
+
+    json_key(w, "hdrs");
+    json_open(w);
+    json_member(w, "user-agent", rec->user_agent);
+    json_close(w);
+
+    if (rec->is_ssl) {
+        json_key(w, "tls");
+        json_open(w);
+        json_member(w, "v", rec->tls_v);
+        json_member(w, "cipher", rec->tls_cipher);
+        json_member(w, "client_verify", rec->tls_client_verify);
+        json_member(w, "sni", rec->tls_sni);
+        json_close(w);
+    }
+
+    json_close(w);
 }
 
-static int
-log_json_post_config(
-    apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, server_rec *s)
+static const char *
+log_json(request_rec *r, char *a)
 {
-    void *userdata_data = NULL;
-    const char *userdata_key = "log_json_init";
-
-    apr_pool_userdata_get(&userdata_data, userdata_key, s->process->pool);
-    if (userdata_data == NULL) {
-        apr_pool_userdata_set((const void *)1, userdata_key,
-            apr_pool_cleanup_null, s->process->pool);
-        return OK;
+    log_json_record rec;
+    log_json_writer w;
+
+    rec.log_id = r->log_id;
+    rec.vhost = r->server->server_hostname;
+    rec.status = apr_itoa(r->pool, r->status);
+    rec.proto = r->protocol;
+    rec.method = r->method;
+    rec.uri = r->uri;
+    rec.srcip = r->useragent_ip;
+    rec.bytes_sent = apr_off_t_toa(r->pool, r->bytes_sent);
+    rec.user = r->user;
+    rec.user_agent = apr_table_get(r->headers_in, "User-Agent");
+    rec.is_ssl = ap_ssl_conn_is_ssl(r->connection);
+    if (rec.is_ssl) {
+        rec.tls_v = ap_ssl_var_lookup(
+            r->pool, r->server, r->connection, r, "SSL_PROTOCOL");
+        rec.tls_cipher = ap_ssl_var_lookup(
+            r->pool, r->server, r->connection, r, "SSL_CIPHER");
+        rec.tls_client_verify = ap_ssl_var_lookup(
+            r->pool, r->server, r->connection, r, "SSL_CLIENT_VERIFY");
+        rec.tls_sni = ap_ssl_var_lookup(
+            r->pool, r->server, r->connection, r, "SSL_TLS_SNI");
     }
 
-    /* http://jansson.readthedocs.io/en/2.8/portability.html#portability-thread-safety
-     */
-    json_object_seed(0);
+    w.out = NULL;
+    w.len = 0;
+    log_json_write(&w, &rec);
+
+    w.out = apr_palloc(r->pool, w.len + 1);
+    w.len = 0;
+    log_json_write(&w, &rec);
+    w.out[w.len] = '\0';
+
+    return w.out;
+}
 
+static int
+log_json_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
+{
+    log_json_register = APR_RETRIEVE_OPTIONAL_FN(ap_register_log_handler);
+    log_json_register(p, "^JS", log_json, 0);
     return OK;
 }
 
@@ -172,7 +203,6 @@ static void
 register_hooks(apr_pool_t *pool)
 {
     ap_hook_pre_config(log_json_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
-    ap_hook_post_config(log_json_post_config, NULL, NULL, APR_HOOK_MIDDLE);
 }
 
 module AP_MODULE_DECLARE_DATA log_json_module = {STANDARD20_MODULE_STUFF, NULL,
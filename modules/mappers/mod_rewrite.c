@@ -48,6 +48,7 @@
 
 #include "apr.h"
 #include "apr_strings.h"
+#include "apr_atomic.h"
 #include "apr_hash.h"
 #include "apr_user.h"
 #include "apr_lib.h"
@@ -224,6 +225,11 @@ static const char* really_last_key = "rewrite_really_last";
 #define REWRITE_PRG_MAP_BUF 1024
 #endif
 
+/* max number of programs started for one prg rewrite map */
+#ifndef REWRITE_MAX_PRG_PROCESSES
+#define REWRITE_MAX_PRG_PROCESSES 64
+#endif
+
 /* for better readbility */
 #define LEFT_CURLY  '{'
 #define RIGHT_CURLY '}'
@@ -256,15 +262,24 @@ static const char* really_last_key = "rewrite_really_last";
  * +-------------------------------------------------------+
  */
 
+/* one running program of a prg map, the lock makes sure its requests
+ * and responses stay in sync
+ */
+typedef struct rewritemap_prg {
+    apr_file_t *fpin;              /* in  file pointer of the program     */
+    apr_file_t *fpout;             /* out file pointer of the program     */
+    apr_global_mutex_t *lock;      /* rewrite-map mutex for this program  */
+} rewritemap_prg;
+
 typedef struct {
     const char *datafile;          /* filename for map data files         */
     const char *dbmtype;           /* dbm type for dbm map data files     */
     const char *checkfile;         /* filename to check for map existence */
     const char *cachename;         /* for cached maps (txt/rnd/dbm)       */
     int   type;                    /* the type of the map                 */
-    apr_file_t *fpin;              /* in  file pointer for program maps   */
-    apr_file_t *fpout;             /* out file pointer for program maps   */
-    apr_file_t *fperr;             /* err file pointer for program maps   */
+    rewritemap_prg *prgs;          /* the running programs for prg maps   */
+    int   nprgs;                   /* how many programs to run            */
+    apr_uint32_t next_prg;         /* round robin index into prgs         */
     char *(*func)(request_rec *,   /* function pointer for internal maps  */
                   char *);
     char **argv;                   /* argv of the external rewrite map    */
@@ -273,6 +288,8 @@ typedef struct {
                                       NULL if only one file               */
     const char *user;              /* run RewriteMap program as this user */
     const char *group;             /* run RewriteMap program as this group */
+    apr_hash_t *entries;           /* txt/rnd map contents read at startup */
+    apr_time_t entries_mtime;      /* mtime of the file when it was read  */
 } rewritemap_entry;
 
 /* special pattern types for RewriteCond */
@@ -318,6 +335,9 @@ typedef struct {
     apr_array_header_t *rewriteconds;/* the corresponding RewriteCond entries */
     char      *pattern;              /* the RegExp pattern string             */
     ap_regex_t *regexp;              /* the RegExp pattern compilation        */
+    char      *prefix;               /* literal any match has to start with   */
+    apr_size_t prefixlen;            /* length of this prefix, or 0           */
+    int        prefix_icase;         /* compare this prefix case-insensitive  */
     char      *output;               /* the Substitution string               */
     int        flags;                /* Flags which control the substitution  */
     char      *forced_mimetype;      /* forced MIME type of substitution      */
@@ -423,9 +443,8 @@ static cache *cachep;
 /* whether proxy module is available or not */
 static int proxy_available;
 
-/* Locks/Mutexes */
-static int rewrite_lock_needed = 0;
-static apr_global_mutex_t *rewrite_mapr_lock_acquire = NULL;
+/* Locks/Mutexes, one per running rewritemap_prg */
+static apr_array_header_t *rewritemap_prgs = NULL;
 static const char *rewritemap_mutex_type = "rewrite-map";
 
 /* Optional functions imported from mod_ssl when loaded: */
@@ -1297,10 +1316,10 @@ static apr_status_t run_rewritemap_programs(server_rec *s, apr_pool_t *p)
     }
 
     for (hi = apr_hash_first(p, conf->rewritemaps); hi; hi = apr_hash_next(hi)){
-        apr_file_t *fpin = NULL;
-        apr_file_t *fpout = NULL;
         rewritemap_entry *map;
+        rewritemap_prg *prgs;
         void *val;
+        int i;
 
         apr_hash_this(hi, NULL, NULL, &val);
         map = val;
@@ -1308,21 +1327,34 @@ static apr_status_t run_rewritemap_programs(server_rec *s, apr_pool_t *p)
         if (map->type != MAPTYPE_PRG) {
             continue;
         }
-        if (!(map->argv[0]) || !*(map->argv[0]) || map->fpin || map->fpout) {
+        if (!(map->argv[0]) || !*(map->argv[0]) || map->prgs) {
             continue;
         }
 
-        rc = rewritemap_program_child(p, map->argv[0], map->argv,
-                                      map->user, map->group,
-                                      &fpout, &fpin);
-        if (rc != APR_SUCCESS || fpin == NULL || fpout == NULL) {
-            ap_log_error(APLOG_MARK, APLOG_ERR, rc, s, APLOGNO(00654)
-                         "mod_rewrite: could not start RewriteMap "
-                         "program %s", map->checkfile);
-            return rc;
+        prgs = apr_pcalloc(p, map->nprgs * sizeof(*prgs));
+        for (i = 0; i < map->nprgs; ++i) {
+            rewritemap_prg *prg = &prgs[i];
+
+            rc = rewritemap_program_child(p, map->argv[0], map->argv,
+                                          map->user, map->group,
+                                          &prg->fpout, &prg->fpin);
+            if (rc != APR_SUCCESS || prg->fpin == NULL || prg->fpout == NULL) {
+                ap_log_error(APLOG_MARK, APLOG_ERR, rc, s, APLOGNO(00654)
+                             "mod_rewrite: could not start RewriteMap "
+                             "program %s", map->checkfile);
+                return rc;
+            }
+
+            rc = ap_global_mutex_create(&prg->lock, NULL,
+                                        rewritemap_mutex_type,
+                                        apr_itoa(p, rewritemap_prgs->nelts),
+                                        s, p, 0);
+            if (rc != APR_SUCCESS) {
+                return rc;
+            }
+            APR_ARRAY_PUSH(rewritemap_prgs, rewritemap_prg *) = prg;
         }
-        map->fpin  = fpin;
-        map->fpout = fpout;
+        map->prgs = prgs;
     }
 
     return APR_SUCCESS;
@@ -1397,6 +1429,60 @@ static char *lookup_map_txtfile(request_rec *r, const char *file, char *key)
     return value;
 }
 
+/*
+ * Read a whole text map into a hash, with the same parsing rules as
+ * lookup_map_txtfile() (the first line for a key wins).
+ */
+static apr_status_t load_map_txtfile(apr_pool_t *p, const char *file,
+                                     apr_hash_t *entries)
+{
+    apr_file_t *fp = NULL;
+    char line[REWRITE_MAX_TXT_MAP_LINE + 1]; /* +1 for \0 */
+    apr_status_t rv;
+
+    if ((rv = apr_file_open(&fp, file, APR_READ|APR_BUFFERED, APR_OS_DEFAULT,
+                            p)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    while (apr_file_gets(line, sizeof(line), fp) == APR_SUCCESS) {
+        char *p1, *p2, *v1;
+
+        /* ignore comments and lines starting with whitespaces */
+        if (*line == '#' || apr_isspace(*line)) {
+            continue;
+        }
+
+        p1 = line;
+        while (*p1 && !apr_isspace(*p1)) {
+            ++p1;
+        }
+        if (!*p1) {
+            continue;
+        }
+
+        v1 = p1;
+        while (apr_isspace(*v1)) {
+            ++v1;
+        }
+        if (!*v1) {
+            continue;
+        }
+        p2 = v1;
+        while (*p2 && !apr_isspace(*p2)) {
+            ++p2;
+        }
+
+        if (!apr_hash_get(entries, line, p1 - line)) {
+            apr_hash_set(entries, apr_pstrmemdup(p, line, p1 - line),
+                         p1 - line, apr_pstrmemdup(p, v1, p2 - v1));
+        }
+    }
+    apr_file_close(fp);
+
+    return APR_SUCCESS;
+}
+
 static char *lookup_map_dbmfile(request_rec *r, const char *file,
                                 const char *dbmtype, char *key)
 {
@@ -1507,9 +1593,43 @@ static char *lookup_map_dbd(request_rec *r, char *key, const char *label)
     }
 }
 
-static char *lookup_map_program(request_rec *r, apr_file_t *fpin,
-                                apr_file_t *fpout, char *key)
+/*
+ * Take the lock of one of the programs of a map. With several of them,
+ * an idle one is preferred, starting at a different one for each lookup
+ * so that they are all used.
+ */
+static rewritemap_prg *lock_map_program(request_rec *r, rewritemap_entry *map)
 {
+    rewritemap_prg *prg;
+    apr_status_t rv;
+    int i, start = 0;
+
+    if (map->nprgs > 1) {
+        start = apr_atomic_inc32(&map->next_prg) % map->nprgs;
+        for (i = 0; i < map->nprgs; ++i) {
+            prg = &map->prgs[(start + i) % map->nprgs];
+            if (apr_global_mutex_trylock(prg->lock) == APR_SUCCESS) {
+                return prg;
+            }
+        }
+    }
+
+    /* all busy, wait for our turn */
+    prg = &map->prgs[start];
+    rv = apr_global_mutex_lock(prg->lock);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(00659)
+                      "apr_global_mutex_lock(rewrite-map) failed");
+        return NULL; /* Maybe this should be fatal? */
+    }
+    return prg;
+}
+
+static char *lookup_map_program(request_rec *r, rewritemap_entry *map,
+                                char *key)
+{
+    rewritemap_prg *prg;
+    apr_file_t *fpin, *fpout;
     char *buf;
     char c;
     apr_size_t i, nbytes, combined_len = 0;
@@ -1534,20 +1654,16 @@ static char *lookup_map_program(request_rec *r, apr_file_t *fpin,
      * after the \n instead of the new key etc etc - in other words,
      * the Rewritemap falls out of sync with the requests).
      */
-    if (fpin == NULL || fpout == NULL || ap_strchr(key, '\n')) {
+    if (map->prgs == NULL || ap_strchr(key, '\n')) {
         return NULL;
     }
 
     /* take the lock */
-    if (rewrite_mapr_lock_acquire) {
-        rv = apr_global_mutex_lock(rewrite_mapr_lock_acquire);
-        if (rv != APR_SUCCESS) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(00659)
-                          "apr_global_mutex_lock(rewrite_mapr_lock_acquire) "
-                          "failed");
-            return NULL; /* Maybe this should be fatal? */
-        }
+    if ((prg = lock_map_program(r, map)) == NULL) {
+        return NULL;
     }
+    fpin = prg->fpin;
+    fpout = prg->fpout;
 
     /* write out the request key */
 #ifdef NO_WRITEV
@@ -1653,14 +1769,11 @@ static char *lookup_map_program(request_rec *r, apr_file_t *fpin,
     }
 
     /* give the lock back */
-    if (rewrite_mapr_lock_acquire) {
-        rv = apr_global_mutex_unlock(rewrite_mapr_lock_acquire);
-        if (rv != APR_SUCCESS) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(00660)
-                          "apr_global_mutex_unlock(rewrite_mapr_lock_acquire) "
-                          "failed");
-            return NULL; /* Maybe this should be fatal? */
-        }
+    rv = apr_global_mutex_unlock(prg->lock);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(00660)
+                      "apr_global_mutex_unlock(rewrite-map) failed");
+        return NULL; /* Maybe this should be fatal? */
     }
 
     /* catch the "failed" case */
@@ -1705,8 +1818,20 @@ static char *lookup_map(request_rec *r, char *name, char *key)
             return NULL;
         }
 
-        value = get_cache_value(s->cachename, st.mtime, key, r->pool);
-        if (!value) {
+        if (s->entries && s->entries_mtime == st.mtime) {
+            /* unchanged since startup, no need to lock or read */
+            value = apr_hash_get(s->entries, key, APR_HASH_KEY_STRING);
+            if (!value) {
+                rewritelog(r, 5, NULL, "map lookup FAILED: map=%s[txt] "
+                           "key=%s", name, key);
+                return NULL;
+            }
+            value = apr_pstrdup(r->pool, value);
+            rewritelog(r, 5, NULL, "preloaded map lookup OK: map=%s[txt] "
+                       "key=%s -> val=%s", name, key, value);
+        }
+        else if (!(value = get_cache_value(s->cachename, st.mtime, key,
+                                           r->pool))) {
             rewritelog(r, 6, NULL,
                        "cache lookup FAILED, forcing new map lookup");
             
@@ -1833,7 +1958,7 @@ static char *lookup_map(request_rec *r, char *name, char *key)
      * Program file map
      */
     case MAPTYPE_PRG:
-        value = lookup_map_program(r, s->fpin, s->fpout, key);
+        value = lookup_map_program(r, s, key);
         if (!value) {
             rewritelog(r, 5, NULL, "map lookup FAILED: map=%s key=%s", name,
                        key);
@@ -2756,27 +2881,10 @@ static char *expand_tildepaths(request_rec *r, char *uri)
  * +-------------------------------------------------------+
  */
 
-static apr_status_t rewritelock_create(server_rec *s, apr_pool_t *p)
-{
-    apr_status_t rc;
-
-    /* create the lockfile */
-    rc = ap_global_mutex_create(&rewrite_mapr_lock_acquire, NULL,
-                                rewritemap_mutex_type, NULL, s, p, 0);
-    if (rc != APR_SUCCESS) {
-        return rc;
-    }
-
-    return APR_SUCCESS;
-}
-
 static apr_status_t rewritelock_remove(void *data)
 {
-    /* destroy the rewritelock */
-    if (rewrite_mapr_lock_acquire) {
-        apr_global_mutex_destroy(rewrite_mapr_lock_acquire);
-        rewrite_mapr_lock_acquire = NULL;
-    }
+    /* the locks themselves go away with the pool */
+    rewritemap_prgs = NULL;
     return APR_SUCCESS;
 }
 
@@ -3250,12 +3358,30 @@ static const char *cmd_rewritemap(cmd_parms *cmd, void *dconf, const char *a1,
 
         newmap->type      = MAPTYPE_PRG;
         newmap->checkfile = newmap->argv[0];
-        rewrite_lock_needed = 1;
+        newmap->nprgs     = 1;
 
         if (a3) {
-            char *tok_cntx;
-            newmap->user = apr_strtok(apr_pstrdup(cmd->pool, a3), ":", &tok_cntx);
-            newmap->group = apr_strtok(NULL, ":", &tok_cntx);
+            char *tok_cntx, *opt;
+
+            /* comma separated [user[:group]] and processes=N */
+            for (opt = apr_strtok(apr_pstrdup(cmd->pool, a3), ",", &tok_cntx);
+                 opt; opt = apr_strtok(NULL, ",", &tok_cntx)) {
+                if (strncasecmp(opt, "processes=", 10) == 0) {
+                    newmap->nprgs = atoi(opt + 10);
+                    if (newmap->nprgs < 1
+                        || newmap->nprgs > REWRITE_MAX_PRG_PROCESSES) {
+                        return apr_psprintf(cmd->pool, "RewriteMap: "
+                                            "processes must be between 1 "
+                                            "and %d",
+                                            REWRITE_MAX_PRG_PROCESSES);
+                    }
+                }
+                else {
+                    char *ug_cntx;
+                    newmap->user = apr_strtok(opt, ":", &ug_cntx);
+                    newmap->group = apr_strtok(NULL, ":", &ug_cntx);
+                }
+            }
         }
     }
     else if (strncasecmp(a2, "int:", 4) == 0) {
@@ -3836,6 +3962,61 @@ static const char *cmd_rewriterule_setflag(apr_pool_t *p, void *_cfg,
     return NULL;
 }
 
+/*
+ * Extract the literal string a match of an anchored pattern must start
+ * with, e.g. "/app/v" from "^/app/v[0-9]+/(.*)$". Subjects not starting
+ * with it can be rejected without running the regex engine, which makes
+ * long lists of rules for distinct URL spaces considerably cheaper.
+ * Anything not obviously literal ends the prefix, and patterns with an
+ * alternation anywhere get none, so this errs on the side of returning
+ * a shorter prefix or NULL.
+ */
+static char *literal_prefix(apr_pool_t *p, const char *pattern,
+                            apr_size_t *len)
+{
+    const char *s;
+    char *prefix, *d;
+
+    *len = 0;
+    if (*pattern != '^' || ap_strchr_c(pattern, '|')) {
+        return NULL;
+    }
+
+    prefix = d = apr_palloc(p, strlen(pattern));
+    s = pattern + 1;
+    while (*s) {
+        char c;
+
+        if (*s == '\\') {
+            /* escaped punctuation is literal, \d, \Q, backrefs etc. not */
+            if (!s[1] || apr_isalnum(s[1])) {
+                break;
+            }
+            c = s[1];
+            s += 2;
+        }
+        else if (ap_strchr_c("^$.[]()?*+{}", *s)) {
+            break;
+        }
+        else {
+            c = *s++;
+        }
+
+        /* a quantifier may make this character optional */
+        if (*s == '?' || *s == '*' || *s == '{') {
+            break;
+        }
+        *d++ = c;
+        if (*s == '+') {
+            break;
+        }
+    }
+    *d = '\0';
+    *len = d - prefix;
+
+    return *len ? prefix : NULL;
+}
+
 static const char *cmd_rewriterule(cmd_parms *cmd, void *in_dconf,
                                    const char *in_str)
 {
@@ -3901,6 +4082,9 @@ static const char *cmd_rewriterule(cmd_parms *cmd, void *in_dconf,
 
     newrule->pattern = a1;
     newrule->regexp  = regexp;
+    newrule->prefix  = literal_prefix(cmd->pool, a1, &newrule->prefixlen);
+    newrule->prefix_icase = (newrule->flags & RULEFLAG_NOCASE)
+                            || (ap_regcomp_get_default_cflags() & AP_REG_ICASE);
 
     /* arg2: the output string */
     newrule->output = a2;
@@ -4223,7 +4407,16 @@ static int apply_rewrite_rule(rewriterule_entry *p, rewrite_ctx *ctx)
     rewritelog(r, 3, ctx->perdir, "applying pattern '%s' to uri '%s'",
                 p->pattern, ctx->uri);
 
-    rc = !ap_regexec(p->regexp, ctx->uri, AP_MAX_REG_MATCH, regmatch, 0);
+    if (p->prefixlen
+        && (p->prefix_icase
+            ? ap_cstr_casecmpn(ctx->uri, p->prefix, p->prefixlen)
+            : strncmp(ctx->uri, p->prefix, p->prefixlen))) {
+        /* cannot match, spare the regex engine */
+        rc = 0;
+    }
+    else {
+        rc = !ap_regexec(p->regexp, ctx->uri, AP_MAX_REG_MATCH, regmatch, 0);
+    }
     if (! (( rc && !(p->flags & RULEFLAG_NOTMATCH)) ||
            (!rc &&  (p->flags & RULEFLAG_NOTMATCH))   ) ) {
         return 0;
@@ -4597,7 +4790,6 @@ static int pre_config(apr_pool_t *pconf,
 {
     APR_OPTIONAL_FN_TYPE(ap_register_rewrite_mapfunc) *map_pfn_register;
 
-    rewrite_lock_needed = 0; 
     ap_mutex_register(pconf, rewritemap_mutex_type, NULL, APR_LOCK_DEFAULT, 0);
 
     /* register int: rewritemap handlers */
@@ -4613,34 +4805,79 @@ static int pre_config(apr_pool_t *pconf,
     return OK;
 }
 
-static int post_config(apr_pool_t *p,
-                       apr_pool_t *plog,
-                       apr_pool_t *ptemp,
-                       server_rec *s)
+/*
+ * Read the txt: and rnd: maps in the parent, so that the children
+ * share one copy of their contents, and look keys up in it as long as
+ * the file has not been changed since.
+ */
+static void preload_rewritemaps(server_rec *s, apr_pool_t *p)
 {
+    rewrite_server_conf *conf;
+    apr_hash_index_t *hi;
     apr_status_t rv;
 
-    /* check if proxy module is available */
-    proxy_available = (ap_find_linked_module("mod_proxy.c") != NULL);
+    conf = ap_get_module_config(s->module_config, &rewrite_module);
+    if (conf->state == ENGINE_DISABLED) {
+        return;
+    }
 
-    if (rewrite_lock_needed) {
-        rv = rewritelock_create(s, p);
-        if (rv != APR_SUCCESS) {
-            return HTTP_INTERNAL_SERVER_ERROR;
+    for (hi = apr_hash_first(p, conf->rewritemaps); hi;
+         hi = apr_hash_next(hi)) {
+        rewritemap_entry *map;
+        apr_hash_t *entries = NULL;
+        apr_finfo_t st;
+        void *val;
+
+        apr_hash_this(hi, NULL, NULL, &val);
+        map = val;
+
+        /* maps inherited from the main server are already done */
+        if ((map->type != MAPTYPE_TXT && map->type != MAPTYPE_RND)
+            || map->entries) {
+            continue;
         }
 
-        apr_pool_cleanup_register(p, (void *)s, rewritelock_remove,
-                apr_pool_cleanup_null);
+        rv = apr_stat(&st, map->checkfile, APR_FINFO_MIN, p);
+        if (rv == APR_SUCCESS) {
+            entries = apr_hash_make(p);
+            rv = load_map_txtfile(p, map->datafile, entries);
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(10459)
+                         "mod_rewrite: can't preload text RewriteMap file "
+                         "%s, looking it up at runtime", map->datafile);
+            continue;
+        }
+        map->entries = entries;
+        map->entries_mtime = st.mtime;
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10460)
+                     "mod_rewrite: preloaded %u entries from text "
+                     "RewriteMap file %s", apr_hash_count(entries),
+                     map->datafile);
     }
+}
+
+static int post_config(apr_pool_t *p,
+                       apr_pool_t *plog,
+                       apr_pool_t *ptemp,
+                       server_rec *s)
+{
+    /* check if proxy module is available */
+    proxy_available = (ap_find_linked_module("mod_proxy.c") != NULL);
 
     /* if we are not doing the initial config, step through the servers and
      * open the RewriteMap prg:xxx programs,
      */
     if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_CONFIG) {
+        rewritemap_prgs = apr_array_make(p, 2, sizeof(rewritemap_prg *));
+        apr_pool_cleanup_register(p, NULL, rewritelock_remove,
+                                  apr_pool_cleanup_null);
+
         for (; s; s = s->next) {
             if (run_rewritemap_programs(s, p) != APR_SUCCESS) {
                 return HTTP_INTERNAL_SERVER_ERROR;
             }
+            preload_rewritemaps(s, p);
         }
     }
 
@@ -4651,13 +4888,19 @@ static void init_child(apr_pool_t *p, server_rec *s)
 {
     apr_status_t rv = 0; /* get a rid of gcc warning (REWRITELOG_DISABLED) */
 
-    if (rewrite_mapr_lock_acquire) {
-        rv = apr_global_mutex_child_init(&rewrite_mapr_lock_acquire,
-                 apr_global_mutex_lockfile(rewrite_mapr_lock_acquire), p);
-        if (rv != APR_SUCCESS) {
-            ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(00666)
-                         "mod_rewrite: could not init rewrite_mapr_lock_acquire"
-                         " in child");
+    if (rewritemap_prgs) {
+        int i;
+
+        for (i = 0; i < rewritemap_prgs->nelts; ++i) {
+            rewritemap_prg *prg = APR_ARRAY_IDX(rewritemap_prgs, i,
+                                                rewritemap_prg *);
+            rv = apr_global_mutex_child_init(&prg->lock,
+                     apr_global_mutex_lockfile(prg->lock), p);
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(00666)
+                             "mod_rewrite: could not init rewrite-map mutex"
+                             " in child");
+            }
         }
     }
 
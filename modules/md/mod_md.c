@@ -831,6 +831,7 @@ static apr_status_t md_post_config_before_ssl(apr_pool_t *p, apr_pool_t *plog,
     apr_status_t rv = APR_SUCCESS;
     int dry_run = 0, log_level = APLOG_DEBUG;
     md_store_t *store;
+    apr_time_t start = apr_time_now();
 
     apr_pool_userdata_get(&data, mod_md_init_key, s->process->pool);
     if (data == NULL) {
@@ -930,6 +931,9 @@ static apr_status_t md_post_config_before_ssl(apr_pool_t *p, apr_pool_t *plog,
     }
     /*5*/
     md_reg_load_stagings(mc->reg, mc->mds, mc->env, p);
+    ap_log_error( APLOG_MARK, log_level, 0, s, APLOGNO(10485)
+                 "%d mds synced with the store in %" APR_TIME_T_FMT " ms",
+                 mc->mds->nelts, apr_time_as_msec(apr_time_now() - start));
 leave:
     md_reg_unlock_global(mc->reg, ptemp);
     return rv;
@@ -943,6 +947,7 @@ static apr_status_t md_post_config_after_ssl(apr_pool_t *p, apr_pool_t *plog,
     md_mod_conf_t *mc;
     int watched, i;
     md_t *md;
+    apr_time_t start = apr_time_now();
 
     (void)ptemp;
     (void)plog;
@@ -1008,6 +1013,12 @@ static apr_status_t md_post_config_after_ssl(apr_pool_t *p, apr_pool_t *plog,
     rv = md_ocsp_start_watching(mc, s, p);
 
 leave:
+    if (APR_SUCCESS == rv && sc && sc->mc && !sc->mc->dry_run) {
+        ap_log_error( APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(10486)
+                     "%d mds checked and set up in %" APR_TIME_T_FMT " ms",
+                     sc->mc->mds->nelts,
+                     apr_time_as_msec(apr_time_now() - start));
+    }
     ap_log_error( APLOG_MARK, APLOG_TRACE2, rv, s, "post_config done");
     return rv;
 }
@@ -67,8 +67,62 @@ struct md_renew_ctx_t {
     ap_watchdog_t *watchdog;
     
     apr_array_header_t *jobs;
+    apr_array_header_t *queue;
 };
 
+/* Entries in the renewal queue, a binary min-heap on the time a job
+ * next needs attention. Only jobs at the head of the queue are loaded
+ * and processed in a watchdog run, all others are left untouched. */
+typedef struct {
+    apr_time_t due;
+    md_job_t *job;
+} md_drive_entry_t;
+
+#define QUEUE_AT(q, i)      APR_ARRAY_IDX((q), (i), md_drive_entry_t)
+
+static void queue_push(apr_array_header_t *q, md_job_t *job, apr_time_t due)
+{
+    md_drive_entry_t e;
+    int i, parent;
+    
+    e.due = due;
+    e.job = job;
+    apr_array_push(q);
+    i = q->nelts - 1;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (QUEUE_AT(q, parent).due <= due) break;
+        QUEUE_AT(q, i) = QUEUE_AT(q, parent);
+        i = parent;
+    }
+    QUEUE_AT(q, i) = e;
+}
+
+static md_job_t *queue_pop_due(apr_array_header_t *q, apr_time_t now)
+{
+    md_drive_entry_t last;
+    md_job_t *job;
+    int i, child;
+    
+    if (q->nelts <= 0 || QUEUE_AT(q, 0).due > now) return NULL;
+    job = QUEUE_AT(q, 0).job;
+    last = *(md_drive_entry_t*)apr_array_pop(q);
+    if (q->nelts > 0) {
+        i = 0;
+        while ((child = 2 * i + 1) < q->nelts) {
+            if (child + 1 < q->nelts 
+                && QUEUE_AT(q, child + 1).due < QUEUE_AT(q, child).due) {
+                ++child;
+            }
+            if (last.due <= QUEUE_AT(q, child).due) break;
+            QUEUE_AT(q, i) = QUEUE_AT(q, child);
+            i = child;
+        }
+        QUEUE_AT(q, i) = last;
+    }
+    return job;
+}
+
 static void process_drive_job(md_renew_ctx_t *dctx, md_job_t *job, apr_pool_t *ptemp)
 {
     const md_t *md;
@@ -186,11 +240,31 @@ static apr_time_t next_run_default(void)
     return apr_time_now() + apr_time_from_sec(MD_SECS_PER_DAY / 2);
 }
 
+static apr_time_t job_due(md_renew_ctx_t *dctx, md_job_t *job, apr_pool_t *ptemp)
+{
+    const md_t *md;
+    apr_time_t due, renew_at;
+    
+    /* A job asking for a specific time gets it. Otherwise, it participates
+     * in the regular runs, unless its renewal window starts before that. */
+    if (job->next_run) return job->next_run;
+    due = next_run_default();
+    md = md_get_by_name(dctx->mc->mds, job->mdomain);
+    if (md && md_will_renew_cert(md)) {
+        renew_at = md_reg_renew_at(dctx->mc->reg, md, ptemp);
+        if (renew_at > apr_time_now() && renew_at < due) {
+            due = renew_at;
+        }
+    }
+    return due;
+}
+
 static apr_status_t run_watchdog(int state, void *baton, apr_pool_t *ptemp)
 {
     md_renew_ctx_t *dctx = baton;
     md_job_t *job;
-    apr_time_t next_run, wait_time;
+    apr_array_header_t *batch;
+    apr_time_t now, next_run, wait_time;
     int i;
     
     /* mod_watchdog invoked us as a single thread inside the whole server (on this machine).
@@ -204,24 +278,30 @@ static apr_status_t run_watchdog(int state, void *baton, apr_pool_t *ptemp)
             break;
             
         case AP_WATCHDOG_STATE_RUNNING:
+            /* Take all jobs that are due from the queue and process them.
+             * They update their next_run property and are queued again at the
+             * time they want to run next. A job may specify 0 as next_run to 
+             * indicate that it wants to participate in the normal regular runs.
+             * Jobs not yet due are neither loaded nor looked at. We schedule 
+             * ourself at the earliest due time remaining in the queue. */
+            now = apr_time_now();
+            batch = apr_array_make(ptemp, 5, sizeof(md_job_t *));
+            while ((job = queue_pop_due(dctx->queue, now))) {
+                APR_ARRAY_PUSH(batch, md_job_t *) = job;
+            }
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, dctx->s, APLOGNO(10055)
-                         "md watchdog run, auto drive %d mds", dctx->jobs->nelts);
+                         "md watchdog run, auto drive %d of %d mds", 
+                         batch->nelts, dctx->jobs->nelts);
                          
-            /* Process all drive jobs. They will update their next_run property
-             * and we schedule ourself at the earliest of all. A job may specify 0
-             * as next_run to indicate that it wants to participate in the normal
-             * regular runs. */
+            for (i = 0; i < batch->nelts; ++i) {
+                job = APR_ARRAY_IDX(batch, i, md_job_t *);
+                process_drive_job(dctx, job, ptemp);
+                queue_push(dctx->queue, job, job_due(dctx, job, ptemp));
+            }
+
             next_run = next_run_default();
-            for (i = 0; i < dctx->jobs->nelts; ++i) {
-                job = APR_ARRAY_IDX(dctx->jobs, i, md_job_t *);
-                
-                if (apr_time_now() >= job->next_run) {
-                    process_drive_job(dctx, job, ptemp);
-                }
-                
-                if (job->next_run && job->next_run < next_run) {
-                    next_run = job->next_run;
-                }
+            if (dctx->queue->nelts > 0 && QUEUE_AT(dctx->queue, 0).due < next_run) {
+                next_run = QUEUE_AT(dctx->queue, 0).due;
             }
 
             wait_time = next_run - apr_time_now();
@@ -300,6 +380,7 @@ apr_status_t md_renew_start_watching(md_mod_conf_t *mc, server_rec *s, apr_pool_
     dctx->mc = mc;
     
     dctx->jobs = apr_array_make(dctx->p, mc->mds->nelts, sizeof(md_job_t *));
+    dctx->queue = apr_array_make(dctx->p, mc->mds->nelts, sizeof(md_drive_entry_t));
     for (i = 0; i < mc->mds->nelts; ++i) {
         md = APR_ARRAY_IDX(mc->mds, i, md_t*);
         if (!md || !md->watched) continue;
@@ -324,6 +405,9 @@ apr_status_t md_renew_start_watching(md_mod_conf_t *mc, server_rec *s, apr_pool_
             md_store_purge(md_reg_store_get(dctx->mc->reg), p, MD_SG_CHALLENGES, md->name);
             job->error_runs = 0;
         }
+        /* Everyone is looked at in the first run, unless the job has asked
+         * for a later time already. */
+        queue_push(dctx->queue, job, job->next_run);
     }
 
     if (!dctx->jobs->nelts) {
@@ -29,6 +29,8 @@
 #include "util_md5.h"
 #include "util_mutex.h"
 #include "ap_provider.h"
+#include "ap_mpm.h"
+#include "mpm_common.h"
 #include "http_config.h"
 
 #include "mod_proxy.h" /* for proxy_hook_section_post_config() */
@@ -107,6 +109,12 @@ static const command_rec ssl_config_cmds[] = {
     SSL_CMD_SRV(FIPS, FLAG,
                 "Enable FIPS-140 mode "
                 "(`on', `off')")
+    SSL_CMD_SRV(AsyncHandshake, FLAG,
+                "Run the handshake as an async job for async crypto engines "
+                "(`on', `off')")
+    SSL_CMD_SRV(StartupThreads, TAKE1,
+                "Number of threads parsing certificate and key files at startup "
+                "(`1' to parse them while configuring each server)")
     SSL_CMD_ALL(CipherSuite, TAKE12,
                 "Colon-delimited list of permitted SSL Ciphers, optional preceded "
                 "by protocol identifier ('XXX:...:XXX' - see manual)")
@@ -123,6 +131,9 @@ static const command_rec ssl_config_cmds[] = {
     SSL_CMD_SRV(SessionTicketKeyFile, TAKE1,
                 "TLS session ticket encryption/decryption key file (RFC 5077) "
                 "('/path/to/file' - file with 48 bytes of random data)")
+    SSL_CMD_SRV(SessionTicketKeyRotation, TAKE1,
+                "Period of the randomly generated TLS session ticket keys "
+                "('off', '12h', ...)")
 #endif
     SSL_CMD_ALL(CACertificatePath, TAKE1,
                 "SSL CA Certificate path "
@@ -309,6 +320,9 @@ static const command_rec ssl_config_cmds[] = {
                 "SSL stapling option for OCSP Response Error Cache Lifetime")
     SSL_CMD_SRV(StaplingForceURL, TAKE1,
                 "SSL stapling option to Force the OCSP Stapling URL")
+    SSL_CMD_SRV(StaplingPrefetch, FLAG,
+                "SSL stapling switch to renew OCSP responses in the background "
+                "(`on', `off')")
 #endif
 
 #ifdef HAVE_SSL_CONF_CMD
@@ -691,6 +705,88 @@ static int ssl_hook_pre_connection(conn_rec *c, void *csd)
     return ssl_init_ssl_connection(c, NULL);
 }
 
+#ifdef HAVE_SSL_ASYNC
+static void ssl_async_handshake_resume(void *baton)
+{
+    conn_rec *c = baton;
+
+    /* Back to ssl_hook_process_connection(), c->clogging_input_filters
+     * makes the MPM run the process_connection hooks when resumed. */
+    ap_mpm_resume_suspended(c);
+}
+
+static void ssl_async_handshake_timeout(void *baton)
+{
+    conn_rec *c = baton;
+
+    ap_log_cerror(APLOG_MARK, APLOG_INFO, 0, c, APLOGNO(10472)
+                  "SSL handshake timed out waiting for the async job");
+    c->aborted = 1;
+    c->cs->state = CONN_STATE_LINGER;
+    ap_mpm_resume_suspended(c);
+}
+
+/* Suspend the connection in the MPM until the async job of the handshake
+ * can make progress, freeing this worker meanwhile. The poll callback is
+ * registered by ssl_hook_suspend_connection() only, once the MPM has
+ * suspended the connection and can resume it from any thread.
+ */
+static apr_status_t ssl_async_handshake_park(conn_rec *c,
+                                             SSLConnRec *sslconn)
+{
+    apr_status_t rv;
+
+    if (!sslconn->async_pool) {
+        apr_pool_create(&sslconn->async_pool, c->pool);
+        apr_pool_tag(sslconn->async_pool, "ssl_async");
+    }
+    else {
+        apr_pool_clear(sslconn->async_pool);
+    }
+
+    rv = ssl_io_async_pollfds(sslconn->ssl, sslconn->async_pool,
+                              &sslconn->async_pfds);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    sslconn->async_parked = 1;
+    c->clogging_input_filters = 1;
+    c->cs->state = CONN_STATE_SUSPENDED;
+    return APR_SUCCESS;
+}
+
+static void ssl_hook_suspend_connection(conn_rec *c, request_rec *r)
+{
+    SSLConnRec *sslconn = myConnConfig(c);
+    apr_array_header_t *pfds;
+    apr_status_t rv;
+
+    if (!sslconn || !sslconn->async_pfds || !c->cs
+            || c->cs->state != CONN_STATE_SUSPENDED) {
+        return;
+    }
+    pfds = sslconn->async_pfds;
+    sslconn->async_pfds = NULL;
+
+    /* The connection is ours no more once registered, the callback may
+     * already run (and resume it) in another thread.
+     */
+    rv = ap_mpm_register_poll_callback_timeout(sslconn->async_pool, pfds,
+                                               ssl_async_handshake_resume,
+                                               ssl_async_handshake_timeout,
+                                               c, c->base_server->timeout);
+    if (rv != APR_SUCCESS) {
+        ap_log_cerror(APLOG_MARK, APLOG_ERR, rv, c, APLOGNO(10492)
+                      "SSL handshake could not wait for the async job, "
+                      "closing connection");
+        c->aborted = 1;
+        c->cs->state = CONN_STATE_LINGER;
+        ap_mpm_resume_suspended(c);
+    }
+}
+#endif
+
 static int ssl_hook_process_connection(conn_rec* c)
 {
     SSLConnRec *sslconn = myConnConfig(c);
@@ -702,10 +798,40 @@ static int ssl_hook_process_connection(conn_rec* c)
          */
         apr_bucket_brigade* temp;
         apr_status_t rv;
+#ifdef HAVE_SSL_ASYNC
+        int async_mpm = 0;
+
+        if (sslconn->async_parked) {
+            /* Resumed, continue with the MPM's usual processing */
+            sslconn->async_parked = 0;
+            sslconn->async_pfds = NULL;
+            c->clogging_input_filters = 0;
+            c->cs->state = CONN_STATE_READ_REQUEST_LINE;
+        }
+        if (c->cs && !c->master
+            && myModConfig(c->base_server)->async_handshake == TRUE
+            && ap_mpm_query(AP_MPMQ_IS_ASYNC, &async_mpm) == APR_SUCCESS) {
+            sslconn->async_park = async_mpm;
+        }
+#endif
 
         temp = apr_brigade_create(c->pool, c->bucket_alloc);
         rv = ap_get_brigade(c->input_filters, temp,
                             AP_MODE_INIT, APR_BLOCK_READ, 0);
+#ifdef HAVE_SSL_ASYNC
+        if (rv == MODSSL_ERROR_WANT_ASYNC) {
+            if (ssl_async_handshake_park(c, sslconn) == APR_SUCCESS) {
+                sslconn->async_park = 0;
+                apr_brigade_destroy(temp);
+                return DONE;
+            }
+            /* Could not park, wait for the job in this thread then */
+            sslconn->async_park = 0;
+            rv = ap_get_brigade(c->input_filters, temp,
+                                AP_MODE_INIT, APR_BLOCK_READ, 0);
+        }
+        sslconn->async_park = 0;
+#endif
         apr_brigade_destroy(temp);
 
         if (APR_SUCCESS != APR_SUCCESS) {
@@ -734,8 +860,10 @@ static void ssl_register_hooks(apr_pool_t *p)
     /* The ssl_init_Module post_config hook should run before mod_proxy's
      * for the ssl proxy main configs to be merged with vhosts' before being
      * themselves merged with mod_proxy's in proxy_hook_section_post_config.
+     * It also needs to register the SSLStaplingPrefetch watchdog before
+     * mod_watchdog starts its instances.
      */
-    static const char *b_pc[] = { "mod_proxy.c", NULL};
+    static const char *b_pc[] = { "mod_proxy.c", "mod_watchdog.c", NULL};
 
 
     ssl_io_filter_register(p);
@@ -743,6 +871,10 @@ static void ssl_register_hooks(apr_pool_t *p)
     ap_hook_pre_connection(ssl_hook_pre_connection,NULL,NULL, APR_HOOK_MIDDLE);
     ap_hook_process_connection(ssl_hook_process_connection, 
                                                    NULL, NULL, APR_HOOK_MIDDLE);
+#ifdef HAVE_SSL_ASYNC
+    ap_hook_suspend_connection(ssl_hook_suspend_connection,
+                               NULL, NULL, APR_HOOK_MIDDLE);
+#endif
     ap_hook_test_config   (ssl_hook_ConfigTest,    NULL,NULL, APR_HOOK_MIDDLE);
     ap_hook_post_config   (ssl_init_Module,        NULL,b_pc, APR_HOOK_MIDDLE);
     ap_hook_http_scheme   (ssl_hook_http_scheme,   NULL,NULL, APR_HOOK_MIDDLE);
@@ -67,6 +67,15 @@ static SSLModConfigRec *ssl_config_global_create(apr_pool_t *pool, server_rec *s
 #ifdef HAVE_FIPS
     mc->fips = UNSET;
 #endif
+#ifdef HAVE_SSL_ASYNC
+    mc->async_handshake = FALSE;
+#endif
+#ifdef HAVE_OCSP_STAPLING
+    mc->stapling_prefetch = FALSE;
+#endif
+#ifdef HAVE_SSL_STARTUP_THREADS
+    mc->startup_threads = 1;
+#endif
 
     mc->retained = ap_retained_data_get(MODSSL_RETAINED_KEY);
     if (!mc->retained) {
@@ -202,6 +211,7 @@ static void modssl_ctx_init_server(SSLSrvConfigRec *sc,
 
 #ifdef HAVE_TLS_SESSION_TICKETS
     mctx->ticket_key = apr_pcalloc(p, sizeof(*mctx->ticket_key));
+    mctx->ticket_key->rotation = UNSET;
 #endif
 }
 
@@ -335,6 +345,7 @@ static void modssl_ctx_cfg_merge_server(apr_pool_t *p,
 
 #ifdef HAVE_TLS_SESSION_TICKETS
     cfgMergeString(ticket_key->file_path);
+    cfgMergeInt(ticket_key->rotation);
 #endif
 }
 
@@ -863,6 +874,61 @@ const char *ssl_cmd_SSLFIPS(cmd_parms *cmd, void *dcfg, int flag)
     return NULL;
 }
 
+const char *ssl_cmd_SSLStartupThreads(cmd_parms *cmd, void *dcfg,
+                                      const char *arg)
+{
+#ifdef HAVE_SSL_STARTUP_THREADS
+    SSLModConfigRec *mc = myModConfig(cmd->server);
+#endif
+    const char *err;
+    int n;
+
+    if ((err = ap_check_cmd_context(cmd, GLOBAL_ONLY))) {
+        return err;
+    }
+
+    n = atoi(arg);
+    if (n < 1 || n > 64) {
+        return "SSLStartupThreads: number must be between 1 and 64";
+    }
+#ifdef HAVE_SSL_STARTUP_THREADS
+    if (!mc) {
+        return "SSLStartupThreads: cannot be used inside SSLPolicyDefine";
+    }
+    mc->startup_threads = n;
+#else
+    if (n > 1)
+        return "SSLStartupThreads invalid, rebuild httpd with thread "
+               "support and against OpenSSL 1.1.0 or later";
+#endif
+    return NULL;
+}
+
+const char *ssl_cmd_SSLAsyncHandshake(cmd_parms *cmd, void *dcfg, int flag)
+{
+#ifdef HAVE_SSL_ASYNC
+    SSLModConfigRec *mc = myModConfig(cmd->server);
+#endif
+    const char *err;
+
+    if ((err = ap_check_cmd_context(cmd, GLOBAL_ONLY))) {
+        return err;
+    }
+
+#ifdef HAVE_SSL_ASYNC
+    if (!mc) {
+        return "SSLAsyncHandshake: cannot be used inside SSLPolicyDefine";
+    }
+    mc->async_handshake = flag ? TRUE : FALSE;
+#else
+    if (flag)
+        return "SSLAsyncHandshake invalid, rebuild httpd against an SSL "
+               "library with ASYNC support";
+#endif
+
+    return NULL;
+}
+
 const char *ssl_cmd_SSLCipherSuite(cmd_parms *cmd,
                                    void *dcfg,
                                    const char *arg1, const char *arg2)
@@ -1083,6 +1149,28 @@ const char *ssl_cmd_SSLSessionTicketKeyFile(cmd_parms *cmd,
 
     return NULL;
 }
+
+const char *ssl_cmd_SSLSessionTicketKeyRotation(cmd_parms *cmd,
+                                                void *dcfg,
+                                                const char *arg)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    apr_interval_time_t rotation;
+
+    if (strcEQ(arg, "off")) {
+        sc->server->ticket_key->rotation = 0;
+        return NULL;
+    }
+    if (ap_timeout_parameter_parse(arg, &rotation, "s") != APR_SUCCESS
+        || rotation < apr_time_from_sec(60)
+        || rotation > apr_time_from_sec(7 * 86400)) {
+        return "SSLSessionTicketKeyRotation: must be 'off' or a period "
+               "between 60s and 7 days";
+    }
+    sc->server->ticket_key->rotation = (int)apr_time_sec(rotation);
+
+    return NULL;
+}
 #endif
 
 #define NO_PER_DIR_SSL_CA \
@@ -2150,6 +2238,21 @@ const char *ssl_cmd_SSLStaplingForceURL(cmd_parms *cmd, void *dcfg,
     return NULL;
 }
 
+const char *ssl_cmd_SSLStaplingPrefetch(cmd_parms *cmd, void *dcfg, int flag)
+{
+    SSLModConfigRec *mc = myModConfig(cmd->server);
+    const char *err;
+
+    if ((err = ap_check_cmd_context(cmd, GLOBAL_ONLY))) {
+        return err;
+    }
+    if (!mc) {
+        return "SSLStaplingPrefetch: cannot be used inside SSLPolicyDefine";
+    }
+    mc->stapling_prefetch = flag ? TRUE : FALSE;
+    return NULL;
+}
+
 #endif /* HAVE_OCSP_STAPLING */
 
 #ifdef HAVE_SSL_CONF_CMD
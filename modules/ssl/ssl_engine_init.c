@@ -28,12 +28,85 @@
                                         -- Unknown   */
 #include "ssl_private.h"
 
+#include "apr_shm.h"
 #include "mpm_common.h"
 #include "mod_md.h"
 #include "util_md5.h"
 
 static apr_status_t ssl_init_ca_cert_path(server_rec *, apr_pool_t *, const char *,
                                           STACK_OF(X509_NAME) *, STACK_OF(X509_INFO) *);
+static void ssl_init_server_cert_files(server_rec *s, apr_pool_t *p,
+                                       SSLSrvConfigRec *sc);
+
+/*
+ * Certificate stores and server certificate chains already loaded by
+ * the server contexts of this generation, so that virtual hosts with the
+ * same SSLCACertificate*, SSLCARevocation* or SSLCertificateChainFile
+ * settings share one copy instead of each parsing their own.
+ */
+typedef struct {
+    const char *vhost_id;   /* first server which loaded it */
+    X509_STORE *store;
+    STACK_OF(X509_NAME) *ca_list;
+} ssl_shared_store_t;
+
+typedef struct {
+    const char *vhost_id;   /* first server which loaded it */
+    STACK_OF(X509) *chain;
+} ssl_shared_chain_t;
+
+static apr_hash_t *ssl_shared_stores;
+static apr_hash_t *ssl_shared_chains;
+
+#if !MODSSL_USE_OPENSSL_PRE_1_1_API
+static apr_status_t ssl_shared_store_cleanup(void *data)
+{
+    ssl_shared_store_t *shared = data;
+
+    X509_STORE_free(shared->store);
+    if (shared->ca_list) {
+        sk_X509_NAME_pop_free(shared->ca_list, X509_NAME_free);
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t ssl_shared_chain_cleanup(void *data)
+{
+    ssl_shared_chain_t *shared = data;
+
+    sk_X509_pop_free(shared->chain, X509_free);
+    return APR_SUCCESS;
+}
+#endif
+
+#ifdef HAVE_SSL_STARTUP_THREADS
+/*
+ * SSLStartupThreads: the certificate and key files of all servers are
+ * parsed by several threads before the servers are configured one by
+ * one; configuring a server then only takes references to the parsed
+ * objects.  Anything that could not be parsed here (encrypted keys,
+ * broken files) is loaded, and its errors reported, as usual.
+ */
+typedef struct {
+    const char *file;
+    int is_key;
+    X509 *cert;             /* leaf certificate */
+    STACK_OF(X509) *chain;  /* certificates following it */
+    EVP_PKEY *pkey;
+} ssl_preload_t;
+
+typedef struct {
+    apr_array_header_t *files;  /* of ssl_preload_t */
+    volatile apr_uint32_t next;
+} ssl_preload_batch_t;
+
+/* file name -> ssl_preload_t, only while servers are configured */
+static apr_hash_t *ssl_preloaded_certs;
+static apr_hash_t *ssl_preloaded_keys;
+
+static int ssl_no_passwd_prompt_cb(char *buf, int size, int rwflag,
+                                   void *userdata);
+#endif
 
 APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(ssl, SSL, int, init_server,
                                     (server_rec *s,apr_pool_t *p,int is_proxy,SSL_CTX *ctx),
@@ -230,6 +303,195 @@ static APR_INLINE unsigned long modssl_runtime_lib_version(void)
 }
 
 
+#ifdef HAVE_SSL_STARTUP_THREADS
+static void ssl_preload_file(ssl_preload_t *pl)
+{
+    BIO *bio;
+    X509 *x509;
+    unsigned long err;
+
+    ERR_clear_error();
+    if ((bio = BIO_new_file(pl->file, "r")) == NULL) {
+        ERR_clear_error();
+        return;
+    }
+    if (pl->is_key) {
+        pl->pkey = PEM_read_bio_PrivateKey(bio, NULL, ssl_no_passwd_prompt_cb,
+                                           NULL);
+    }
+    else if ((pl->cert = PEM_read_bio_X509_AUX(bio, NULL,
+                                               ssl_no_passwd_prompt_cb,
+                                               NULL)) != NULL) {
+        pl->chain = sk_X509_new_null();
+        while (pl->chain
+               && (x509 = PEM_read_bio_X509(bio, NULL, ssl_no_passwd_prompt_cb,
+                                            NULL)) != NULL) {
+            if (!sk_X509_push(pl->chain, x509)) {
+                X509_free(x509);
+                break;
+            }
+        }
+        /* Anything but the end of the file leaves it to the usual
+         * loading, which reports the error */
+        err = ERR_peek_last_error();
+        if (!pl->chain || (err && !(ERR_GET_LIB(err) == ERR_LIB_PEM
+                                    && ERR_GET_REASON(err) == PEM_R_NO_START_LINE))) {
+            X509_free(pl->cert);
+            pl->cert = NULL;
+        }
+    }
+    BIO_free(bio);
+    ERR_clear_error();
+}
+
+static void ssl_preload_files(ssl_preload_batch_t *batch)
+{
+    apr_uint32_t i;
+
+    while ((i = apr_atomic_inc32(&batch->next))
+           < (apr_uint32_t)batch->files->nelts) {
+        ssl_preload_file(&APR_ARRAY_IDX(batch->files, i, ssl_preload_t));
+    }
+}
+
+static void * APR_THREAD_FUNC ssl_preload_thread(apr_thread_t *thd,
+                                                 void *data)
+{
+    ssl_preload_files(data);
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t ssl_preload_cleanup(void *data)
+{
+    apr_array_header_t *files = data;
+    int i;
+
+    for (i = 0; i < files->nelts; i++) {
+        ssl_preload_t *pl = &APR_ARRAY_IDX(files, i, ssl_preload_t);
+
+        X509_free(pl->cert);
+        sk_X509_pop_free(pl->chain, X509_free);
+        EVP_PKEY_free(pl->pkey);
+    }
+    ssl_preloaded_certs = NULL;
+    ssl_preloaded_keys = NULL;
+    return APR_SUCCESS;
+}
+
+static void ssl_preload_add(apr_hash_t *files, const char *file, int is_key,
+                            ssl_preload_batch_t *batch)
+{
+    ssl_preload_t *pl;
+
+    if (!file || modssl_is_engine_id(file)
+        || apr_hash_get(files, file, APR_HASH_KEY_STRING)) {
+        return;
+    }
+    pl = apr_array_push(batch->files);
+    memset(pl, 0, sizeof(*pl));
+    pl->file = file;
+    pl->is_key = is_key;
+    /* the index, as the array may still move */
+    apr_hash_set(files, file, APR_HASH_KEY_STRING,
+                 (void *)(apr_uintptr_t)batch->files->nelts);
+}
+
+static void ssl_init_preload_files(server_rec *base_server, apr_pool_t *ptemp)
+{
+    SSLModConfigRec *mc = myModConfig(base_server);
+    ssl_preload_batch_t batch;
+    apr_hash_t *certs, *keys;
+    apr_hash_index_t *hi;
+    apr_thread_t **threads;
+    apr_status_t rv;
+    apr_time_t start = apr_time_now();
+    server_rec *s;
+    int i, nthreads;
+
+    if (mc->startup_threads <= 1) {
+        return;
+    }
+
+    batch.files = apr_array_make(ptemp, 64, sizeof(ssl_preload_t));
+    batch.next = 0;
+    certs = apr_hash_make(ptemp);
+    keys = apr_hash_make(ptemp);
+    for (s = base_server; s; s = s->next) {
+        SSLSrvConfigRec *sc = mySrvConfig(s);
+        modssl_pk_server_t *pks = sc->server->pks;
+
+        if (sc->enabled != SSL_ENABLED_TRUE
+            && sc->enabled != SSL_ENABLED_OPTIONAL) {
+            continue;
+        }
+        for (i = 0; i < pks->cert_files->nelts; i++) {
+            const char *certfile = APR_ARRAY_IDX(pks->cert_files, i,
+                                                 const char *);
+            ssl_preload_add(certs, certfile, 0, &batch);
+            ssl_preload_add(keys, i < pks->key_files->nelts ?
+                            APR_ARRAY_IDX(pks->key_files, i, const char *) :
+                            certfile, 1, &batch);
+        }
+    }
+    if (batch.files->nelts < 2) {
+        return;
+    }
+    apr_pool_cleanup_register(ptemp, batch.files, ssl_preload_cleanup,
+                              apr_pool_cleanup_null);
+
+    /* This thread takes its share of the files, too */
+    nthreads = mc->startup_threads - 1;
+    if (nthreads > batch.files->nelts - 1) {
+        nthreads = batch.files->nelts - 1;
+    }
+    threads = apr_pcalloc(ptemp, nthreads * sizeof(*threads));
+    for (i = 0; i < nthreads; i++) {
+        rv = apr_thread_create(&threads[i], NULL, ssl_preload_thread, &batch,
+                               ptemp);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, rv, base_server,
+                         APLOGNO(10483) "Init: cannot create startup thread");
+            threads[i] = NULL;
+            break;
+        }
+    }
+    ssl_preload_files(&batch);
+    for (i = 0; i < nthreads && threads[i]; i++) {
+        apr_status_t thread_rv;
+
+        apr_thread_join(&thread_rv, threads[i]);
+    }
+
+    /* Now the array is final, index the parsed files */
+    ssl_preloaded_certs = certs;
+    ssl_preloaded_keys = keys;
+    for (hi = apr_hash_first(ptemp, certs); hi; hi = apr_hash_next(hi)) {
+        const void *file;
+        void *idx;
+
+        apr_hash_this(hi, &file, NULL, &idx);
+        apr_hash_set(certs, file, APR_HASH_KEY_STRING,
+                     &APR_ARRAY_IDX(batch.files, (apr_uintptr_t)idx - 1,
+                                    ssl_preload_t));
+    }
+    for (hi = apr_hash_first(ptemp, keys); hi; hi = apr_hash_next(hi)) {
+        const void *file;
+        void *idx;
+
+        apr_hash_this(hi, &file, NULL, &idx);
+        apr_hash_set(keys, file, APR_HASH_KEY_STRING,
+                     &APR_ARRAY_IDX(batch.files, (apr_uintptr_t)idx - 1,
+                                    ssl_preload_t));
+    }
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, base_server, APLOGNO(10484)
+                 "Init: Parsed %d certificate and key files with %d "
+                 "threads in %" APR_TIME_T_FMT " ms", batch.files->nelts,
+                 i + 1, apr_time_as_msec(apr_time_now() - start));
+}
+#endif
+
 /*
  *  Per-module initialization
  */
@@ -243,6 +505,9 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
     server_rec *s;
     apr_status_t rv;
     apr_array_header_t *pphrases;
+    apr_time_t init_start, elapsed, slowest_time = -1;
+    server_rec *slowest = NULL;
+    int nservers = 0;
 
     AP_DEBUG_ASSERT(mc);
 
@@ -382,6 +647,15 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
     }
 #endif
 
+#ifdef HAVE_SSL_ASYNC
+    if (mc->async_handshake == TRUE && !ASYNC_is_capable()) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, base_server, APLOGNO(10471)
+                     "SSLAsyncHandshake: " MODSSL_LIBRARY_NAME " cannot run "
+                     "async jobs on this platform, disabled");
+        mc->async_handshake = FALSE;
+    }
+#endif
+
     /*
      * initialize the mutex handling
      */
@@ -391,6 +665,8 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
 #ifdef HAVE_OCSP_STAPLING
     ssl_stapling_certinfo_hash_init(p);
 #endif
+    ssl_shared_stores = apr_hash_make(p);
+    ssl_shared_chains = apr_hash_make(p);
 
     /*
      * initialize session caching
@@ -407,7 +683,20 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
     ap_log_error(APLOG_MARK, APLOG_INFO, 0, base_server, APLOGNO(01887)
                  "Init: Initializing (virtual) servers for SSL");
 
+    init_start = apr_time_now();
     for (s = base_server; s; s = s->next) {
+        sc = mySrvConfig(s);
+        if (sc->enabled == SSL_ENABLED_TRUE || sc->enabled == SSL_ENABLED_OPTIONAL) {
+            ssl_init_server_cert_files(s, p, sc);
+            nservers++;
+        }
+    }
+#ifdef HAVE_SSL_STARTUP_THREADS
+    ssl_init_preload_files(base_server, ptemp);
+#endif
+
+    for (s = base_server; s; s = s->next) {
+        elapsed = apr_time_now();
         sc = mySrvConfig(s);
         /*
          * Either now skip this server when SSL is disabled for
@@ -422,6 +711,21 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
             != APR_SUCCESS) {
             return rv;
         }
+
+        elapsed = apr_time_now() - elapsed;
+        if (elapsed > slowest_time) {
+            slowest_time = elapsed;
+            slowest = s;
+        }
+    }
+
+    if (nservers) {
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, base_server, APLOGNO(10482)
+                     "Init: Configured SSL for %d server(s) in %" APR_TIME_T_FMT
+                     " ms, slowest was %s with %" APR_TIME_T_FMT " ms",
+                     nservers, apr_time_as_msec(apr_time_now() - init_start),
+                     mySrvConfig(slowest)->vhost_id,
+                     apr_time_as_msec(slowest_time));
     }
 
     if (pphrases->nelts > 0) {
@@ -438,6 +742,12 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
         return rv;
     }
 
+#ifdef HAVE_OCSP_STAPLING
+    if ((rv = ssl_stapling_prefetch_init(base_server, p)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
     for (s = base_server; s; s = s->next) {
         SSLDirConfigRec *sdc = ap_get_module_config(s->lookup_defaults,
                                                     &ssl_module);
@@ -966,7 +1276,8 @@ int modssl_CTX_load_verify_locations(SSL_CTX *ctx,
 static apr_status_t ssl_init_ctx_verify(server_rec *s,
                                         apr_pool_t *p,
                                         apr_pool_t *ptemp,
-                                        modssl_ctx_t *mctx)
+                                        modssl_ctx_t *mctx,
+                                        ssl_shared_store_t *shared)
 {
     SSL_CTX *ctx = mctx->ssl_ctx;
 
@@ -999,7 +1310,13 @@ static apr_status_t ssl_init_ctx_verify(server_rec *s,
     /*
      * Configure Client Authentication details
      */
-    if (mctx->auth.ca_cert_file || mctx->auth.ca_cert_path) {
+    if (shared) {
+        /* The store and CA list were loaded for another server already */
+        if (shared->ca_list) {
+            SSL_CTX_set_client_CA_list(ctx, SSL_dup_CA_list(shared->ca_list));
+        }
+    }
+    else if (mctx->auth.ca_cert_file || mctx->auth.ca_cert_path) {
         ap_log_error(APLOG_MARK, APLOG_TRACE1, 0, s,
                      "Configuring client authentication");
 
@@ -1109,7 +1426,8 @@ int modssl_X509_STORE_load_locations(X509_STORE *store,
 static apr_status_t ssl_init_ctx_crl(server_rec *s,
                                      apr_pool_t *p,
                                      apr_pool_t *ptemp,
-                                     modssl_ctx_t *mctx)
+                                     modssl_ctx_t *mctx,
+                                     ssl_shared_store_t *shared)
 {
     X509_STORE *store = SSL_CTX_get_cert_store(mctx->ssl_ctx);
     unsigned long crlflags = 0;
@@ -1141,6 +1459,11 @@ static apr_status_t ssl_init_ctx_crl(server_rec *s,
         return APR_SUCCESS;
     }
 
+    if (shared) {
+        /* CRLs and check flags are in the shared store already */
+        return APR_SUCCESS;
+    }
+
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01900)
                  "Configuring certificate revocation facility");
 
@@ -1247,6 +1570,10 @@ static apr_status_t ssl_init_ctx_cert_chain(server_rec *s,
     BOOL skip_first = FALSE;
     int i, n;
     const char *chain = mctx->cert_chain;
+#if !MODSSL_USE_OPENSSL_PRE_1_1_API
+    const char *key;
+    ssl_shared_chain_t *shared;
+#endif
 
     /*
      * Optionally configure extra server certificate chain certificates.
@@ -1274,12 +1601,53 @@ static apr_status_t ssl_init_ctx_cert_chain(server_rec *s,
         }
     }
 
-    n = use_certificate_chain(mctx->ssl_ctx, (char *)chain, skip_first, NULL);
-    if (n < 0) {
-        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(01903)
-                "Failed to configure CA certificate chain!");
-        ssl_log_ssl_error(SSLLOG_MARK, APLOG_EMERG, s);
-        return ssl_die(s);
+#if !MODSSL_USE_OPENSSL_PRE_1_1_API
+    /* Reuse the certificates if another server loaded this chain */
+    key = apr_pstrcat(ptemp, skip_first ? "1|" : "0|", chain, NULL);
+    shared = apr_hash_get(ssl_shared_chains, key, APR_HASH_KEY_STRING);
+    if (shared) {
+        for (n = 0; n < sk_X509_num(shared->chain); n++) {
+            X509 *x509 = sk_X509_value(shared->chain, n);
+
+            X509_up_ref(x509);
+            if (!SSL_CTX_add_extra_chain_cert(mctx->ssl_ctx, x509)) {
+                X509_free(x509);
+                ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(10481)
+                             "Failed to configure CA certificate chain "
+                             "shared with %s!", shared->vhost_id);
+                ssl_log_ssl_error(SSLLOG_MARK, APLOG_EMERG, s);
+                return ssl_die(s);
+            }
+        }
+    }
+    else
+#endif
+    {
+        n = use_certificate_chain(mctx->ssl_ctx, (char *)chain, skip_first,
+                                  NULL);
+        if (n < 0) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(01903)
+                    "Failed to configure CA certificate chain!");
+            ssl_log_ssl_error(SSLLOG_MARK, APLOG_EMERG, s);
+            return ssl_die(s);
+        }
+#if !MODSSL_USE_OPENSSL_PRE_1_1_API
+        {
+            STACK_OF(X509) *extra_certs = NULL;
+
+            SSL_CTX_get_extra_chain_certs(mctx->ssl_ctx, &extra_certs);
+            if (extra_certs
+                && (extra_certs = X509_chain_up_ref(extra_certs)) != NULL) {
+                shared = apr_palloc(p, sizeof(*shared));
+                shared->vhost_id = mctx->sc->vhost_id;
+                shared->chain = extra_certs;
+                apr_pool_cleanup_register(p, shared, ssl_shared_chain_cleanup,
+                                          apr_pool_cleanup_null);
+                apr_hash_set(ssl_shared_chains, apr_pstrdup(p, key),
+                             APR_HASH_KEY_STRING, shared);
+            }
+        }
+#endif
     }
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01904)
@@ -1290,12 +1658,46 @@ static apr_status_t ssl_init_ctx_cert_chain(server_rec *s,
     return APR_SUCCESS;
 }
 
+/*
+ * Key of the certificate store a server context would load, or NULL
+ * if it loads nothing or cannot share it.
+ */
+static const char *ssl_init_ctx_store_key(apr_pool_t *ptemp,
+                                          modssl_ctx_t *mctx)
+{
+#if MODSSL_USE_OPENSSL_PRE_1_1_API
+    return NULL;
+#else
+    if (!mctx->pks || !(mctx->auth.ca_cert_file || mctx->auth.ca_cert_path
+                        || mctx->crl_file || mctx->crl_path)) {
+        return NULL;
+    }
+    return apr_pstrcat(ptemp,
+                       mctx->auth.ca_cert_file ? mctx->auth.ca_cert_file : "",
+                       "|",
+                       mctx->auth.ca_cert_path ? mctx->auth.ca_cert_path : "",
+                       "|",
+                       mctx->pks->ca_name_file ? mctx->pks->ca_name_file : "",
+                       "|",
+                       mctx->pks->ca_name_path ? mctx->pks->ca_name_path : "",
+                       "|",
+                       mctx->crl_file ? mctx->crl_file : "",
+                       "|",
+                       mctx->crl_path ? mctx->crl_path : "",
+                       "|",
+                       apr_itoa(ptemp, mctx->crl_check_mask),
+                       NULL);
+#endif
+}
+
 static apr_status_t ssl_init_ctx(server_rec *s,
                                  apr_pool_t *p,
                                  apr_pool_t *ptemp,
                                  modssl_ctx_t *mctx)
 {
     apr_status_t rv;
+    const char *store_key = ssl_init_ctx_store_key(ptemp, mctx);
+    ssl_shared_store_t *shared = NULL;
 
     if ((rv = ssl_init_ctx_protocol(s, p, ptemp, mctx)) != APR_SUCCESS) {
         return rv;
@@ -1305,7 +1707,21 @@ static apr_status_t ssl_init_ctx(server_rec *s,
 
     ssl_init_ctx_callbacks(s, p, ptemp, mctx);
 
-    if ((rv = ssl_init_ctx_verify(s, p, ptemp, mctx)) != APR_SUCCESS) {
+#if !MODSSL_USE_OPENSSL_PRE_1_1_API
+    if (store_key) {
+        shared = apr_hash_get(ssl_shared_stores, store_key,
+                              APR_HASH_KEY_STRING);
+    }
+    if (shared) {
+        X509_STORE_up_ref(shared->store);
+        SSL_CTX_set_cert_store(mctx->ssl_ctx, shared->store);
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10480)
+                     "Using the certificate store of %s for %s",
+                     shared->vhost_id, mctx->sc->vhost_id);
+    }
+#endif
+
+    if ((rv = ssl_init_ctx_verify(s, p, ptemp, mctx, shared)) != APR_SUCCESS) {
         return rv;
     }
 
@@ -1313,10 +1729,26 @@ static apr_status_t ssl_init_ctx(server_rec *s,
         return rv;
     }
 
-    if ((rv = ssl_init_ctx_crl(s, p, ptemp, mctx)) != APR_SUCCESS) {
+    if ((rv = ssl_init_ctx_crl(s, p, ptemp, mctx, shared)) != APR_SUCCESS) {
         return rv;
     }
 
+#if !MODSSL_USE_OPENSSL_PRE_1_1_API
+    if (store_key && !shared) {
+        STACK_OF(X509_NAME) *ca_list = SSL_CTX_get_client_CA_list(mctx->ssl_ctx);
+
+        shared = apr_palloc(p, sizeof(*shared));
+        shared->vhost_id = mctx->sc->vhost_id;
+        shared->store = SSL_CTX_get_cert_store(mctx->ssl_ctx);
+        X509_STORE_up_ref(shared->store);
+        shared->ca_list = ca_list ? SSL_dup_CA_list(ca_list) : NULL;
+        apr_pool_cleanup_register(p, shared, ssl_shared_store_cleanup,
+                                  apr_pool_cleanup_null);
+        apr_hash_set(ssl_shared_stores, apr_pstrdup(p, store_key),
+                     APR_HASH_KEY_STRING, shared);
+    }
+#endif
+
     if (mctx->pks) {
         /* XXX: proxy support? */
         if ((rv = ssl_init_ctx_cert_chain(s, p, ptemp, mctx)) != APR_SUCCESS) {
@@ -1393,6 +1825,47 @@ static int ssl_no_passwd_prompt_cb(char *buf, int size, int rwflag,
                                      && ERR_GET_REASON(ec) != X509_R_UNKNOWN_KEY_TYPE))
 #endif
 
+/*
+ * Configure the certificate (with_chain: and the certificates following
+ * it) or the private key parsed from 'file' by SSLStartupThreads, if
+ * any.  Returns 0 if the file has to be loaded as usual.
+ */
+static int ssl_use_preloaded_cert(SSL_CTX *ctx, const char *file,
+                                  int with_chain)
+{
+#ifdef HAVE_SSL_STARTUP_THREADS
+    ssl_preload_t *pl;
+
+    if (ssl_preloaded_certs
+        && (pl = apr_hash_get(ssl_preloaded_certs, file,
+                              APR_HASH_KEY_STRING)) != NULL
+        && pl->cert
+        && SSL_CTX_use_certificate(ctx, pl->cert) == 1
+        && (!with_chain || SSL_CTX_set1_chain(ctx, pl->chain) == 1)) {
+        return 1;
+    }
+    ERR_clear_error();
+#endif
+    return 0;
+}
+
+static int ssl_use_preloaded_key(SSL_CTX *ctx, const char *file)
+{
+#ifdef HAVE_SSL_STARTUP_THREADS
+    ssl_preload_t *pl;
+
+    if (ssl_preloaded_keys
+        && (pl = apr_hash_get(ssl_preloaded_keys, file,
+                              APR_HASH_KEY_STRING)) != NULL
+        && pl->pkey
+        && SSL_CTX_use_PrivateKey(ctx, pl->pkey) == 1) {
+        return 1;
+    }
+    ERR_clear_error();
+#endif
+    return 0;
+}
+
 static apr_status_t ssl_init_server_certs(server_rec *s,
                                           apr_pool_t *p,
                                           apr_pool_t *ptemp,
@@ -1428,8 +1901,9 @@ static apr_status_t ssl_init_server_certs(server_rec *s,
             engine_certfile = certfile;
         }
         else if (mctx->cert_chain) {
-            if ((SSL_CTX_use_certificate_file(mctx->ssl_ctx, certfile,
-                                              SSL_FILETYPE_PEM) < 1)) {
+            if (!ssl_use_preloaded_cert(mctx->ssl_ctx, certfile, 0)
+                && (SSL_CTX_use_certificate_file(mctx->ssl_ctx, certfile,
+                                                 SSL_FILETYPE_PEM) < 1)) {
                 ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02561)
                              "Failed to configure certificate %s, check %s",
                              key_id, certfile);
@@ -1437,8 +1911,9 @@ static apr_status_t ssl_init_server_certs(server_rec *s,
                 return APR_EGENERAL;
             }
         } else {
-            if ((SSL_CTX_use_certificate_chain_file(mctx->ssl_ctx,
-                                                    certfile) < 1)) {
+            if (!ssl_use_preloaded_cert(mctx->ssl_ctx, certfile, 1)
+                && (SSL_CTX_use_certificate_chain_file(mctx->ssl_ctx,
+                                                       certfile) < 1)) {
                 ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02562)
                              "Failed to configure certificate %s (with chain),"
                              " check %s", key_id, certfile);
@@ -1489,8 +1964,9 @@ static apr_status_t ssl_init_server_certs(server_rec *s,
             /* SSL_CTX now owns the key */
             EVP_PKEY_free(pkey);
         }
-        else if ((SSL_CTX_use_PrivateKey_file(mctx->ssl_ctx, keyfile,
-                                              SSL_FILETYPE_PEM) < 1)
+        else if (!ssl_use_preloaded_key(mctx->ssl_ctx, keyfile)
+                 && (SSL_CTX_use_PrivateKey_file(mctx->ssl_ctx, keyfile,
+                                                 SSL_FILETYPE_PEM) < 1)
                  && CHECK_PRIVKEY_ERROR(ERR_peek_last_error())) {
             ssl_asn1_t *asn1;
             const unsigned char *ptr;
@@ -1663,6 +2139,56 @@ static apr_status_t ssl_init_server_certs(server_rec *s,
 }
 
 #ifdef HAVE_TLS_SESSION_TICKETS
+/* The rotated ticket keys of a server are shared by all the processes.
+ * They are allocated once from the process pool, so that restarts keep
+ * them and the tickets issued so far remain valid.
+ */
+static modssl_ticket_keys_t *ssl_ticket_keys_get(server_rec *s,
+                                                 int rotation)
+{
+    apr_pool_t *pp = s->process->pool;
+    const char *vhost_id = mySrvConfig(s)->vhost_id;
+    modssl_ticket_keys_t *keys;
+    apr_hash_t **retained;
+
+    retained = ap_retained_data_get(MODSSL_TICKET_KEYS_RETAINED_KEY);
+    if (!retained) {
+        retained = ap_retained_data_create(MODSSL_TICKET_KEYS_RETAINED_KEY,
+                                           sizeof(*retained));
+        *retained = apr_hash_make(pp);
+    }
+
+    keys = apr_hash_get(*retained, vhost_id, APR_HASH_KEY_STRING);
+    if (!keys) {
+#if APR_HAS_SHARED_MEMORY
+        apr_shm_t *shm;
+        apr_status_t rv;
+
+        rv = apr_shm_create(&shm, sizeof(*keys), NULL, pp);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(10473)
+                         "Failed to create the shared memory for the TLS "
+                         "session ticket keys of %s", vhost_id);
+            return NULL;
+        }
+        keys = apr_shm_baseaddr_get(shm);
+#else
+        keys = apr_palloc(pp, sizeof(*keys));
+#endif
+        memset(keys, 0, sizeof(*keys));
+        apr_hash_set(*retained, apr_pstrdup(pp, vhost_id),
+                     APR_HASH_KEY_STRING, keys);
+    }
+
+    if (keys->rotation != (apr_uint32_t)rotation) {
+        /* Keys of periods with another length, start over */
+        OPENSSL_cleanse(keys, sizeof(*keys));
+        keys->rotation = (apr_uint32_t)rotation;
+    }
+
+    return keys;
+}
+
 static apr_status_t ssl_init_ticket_key(server_rec *s,
                                         apr_pool_t *p,
                                         apr_pool_t *ptemp,
@@ -1676,49 +2202,73 @@ static apr_status_t ssl_init_ticket_key(server_rec *s,
     modssl_ticket_key_t *ticket_key = mctx->ticket_key;
     int res;
 
-    if (!ticket_key->file_path) {
-        return APR_SUCCESS;
+    if (ticket_key->rotation == UNSET) {
+        ticket_key->rotation = 0;
     }
 
-    path = ap_server_root_relative(p, ticket_key->file_path);
+    if (ticket_key->rotation) {
+        if (ticket_key->file_path) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(10491)
+                         "%s: SSLSessionTicketKeyRotation can not be used "
+                         "with SSLSessionTicketKeyFile",
+                         (mySrvConfig(s))->vhost_id);
+            return ssl_die(s);
+        }
+        ticket_key->keys = ssl_ticket_keys_get(s, ticket_key->rotation);
+        if (!ticket_key->keys) {
+            return ssl_die(s);
+        }
+    }
+    else if (ticket_key->file_path) {
+        path = ap_server_root_relative(p, ticket_key->file_path);
 
-    rv = apr_file_open(&fp, path, APR_READ|APR_BINARY,
-                       APR_OS_DEFAULT, ptemp);
+        rv = apr_file_open(&fp, path, APR_READ|APR_BINARY,
+                           APR_OS_DEFAULT, ptemp);
 
-    if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02286)
-                     "Failed to open ticket key file %s: (%d) %pm",
-                     path, rv, &rv);
-        return ssl_die(s);
-    }
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02286)
+                         "Failed to open ticket key file %s: (%d) %pm",
+                         path, rv, &rv);
+            return ssl_die(s);
+        }
 
-    rv = apr_file_read_full(fp, &buf[0], TLSEXT_TICKET_KEY_LEN, &len);
+        rv = apr_file_read_full(fp, &buf[0], TLSEXT_TICKET_KEY_LEN, &len);
 
-    if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02287)
-                     "Failed to read %d bytes from %s: (%d) %pm",
-                     TLSEXT_TICKET_KEY_LEN, path, rv, &rv);
-        return ssl_die(s);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02287)
+                         "Failed to read %d bytes from %s: (%d) %pm",
+                         TLSEXT_TICKET_KEY_LEN, path, rv, &rv);
+            return ssl_die(s);
+        }
+
+        memcpy(ticket_key->key_name, buf, 16);
+        memcpy(ticket_key->aes_key, buf + 32, 16);
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+        memcpy(ticket_key->hmac_secret, buf + 16, 16);
+#else
+        ticket_key->mac_params[0] =
+            OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+                                              apr_pmemdup(p, buf + 16, 16),
+                                              16);
+        ticket_key->mac_params[1] =
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                             "sha256", 0);
+        ticket_key->mac_params[2] =
+            OSSL_PARAM_construct_end();
+#endif
+        OPENSSL_cleanse(buf, sizeof(buf));
+    }
+    else {
+        return APR_SUCCESS;
     }
 
-    memcpy(ticket_key->key_name, buf, 16);
-    memcpy(ticket_key->aes_key, buf + 32, 16);
 #if OPENSSL_VERSION_NUMBER < 0x30000000L
-    memcpy(ticket_key->hmac_secret, buf + 16, 16);
     res = SSL_CTX_set_tlsext_ticket_key_cb(mctx->ssl_ctx,
                                            ssl_callback_SessionTicket);
 #else
-    ticket_key->mac_params[0] =
-        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
-                                          apr_pmemdup(p, buf + 16, 16), 16);
-    ticket_key->mac_params[1] =
-        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "sha256", 0);
-    ticket_key->mac_params[2] =
-        OSSL_PARAM_construct_end();
     res = SSL_CTX_set_tlsext_ticket_key_evp_cb(mctx->ssl_ctx,
                                                ssl_callback_SessionTicket);
 #endif
-    OPENSSL_cleanse(buf, sizeof(buf));
     if (!res) {
         ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(01913)
                      "Unable to initialize TLS session ticket key callback "
@@ -1727,9 +2277,17 @@ static apr_status_t ssl_init_ticket_key(server_rec *s,
         return ssl_die(s);
     }
 
-    ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(02288)
-                 "TLS session ticket key for %s successfully loaded from %s",
-                 (mySrvConfig(s))->vhost_id, path);
+    if (ticket_key->rotation) {
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(10474)
+                     "TLS session ticket keys for %s randomly generated "
+                     "and rotated every %ds", (mySrvConfig(s))->vhost_id,
+                     ticket_key->rotation);
+    }
+    else {
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(02288)
+                     "TLS session ticket key for %s successfully loaded "
+                     "from %s", (mySrvConfig(s))->vhost_id, path);
+    }
 
     return APR_SUCCESS;
 }
@@ -2012,13 +2570,11 @@ static apr_status_t ssl_init_server_ctx(server_rec *s,
                                         apr_array_header_t *pphrases)
 {
     apr_status_t rv;
-    modssl_pk_server_t *pks;
 #ifdef HAVE_SSL_CONF_CMD
     ssl_ctx_param_t *param = (ssl_ctx_param_t *)sc->server->ssl_ctx_param->elts;
     SSL_CONF_CTX *cctx = sc->server->ssl_ctx_config;
     int i;
 #endif
-    int n;
 
     /*
      *  Check for problematic re-initializations
@@ -2030,30 +2586,6 @@ static apr_status_t ssl_init_server_ctx(server_rec *s,
         return APR_EGENERAL;
     }
 
-    /* Allow others to provide certificate files */
-    pks = sc->server->pks;
-    n = pks->cert_files->nelts;
-    ap_ssl_add_cert_files(s, p, pks->cert_files, pks->key_files);
-    ssl_run_add_cert_files(s, p, pks->cert_files, pks->key_files);
-
-    if (apr_is_empty_array(pks->cert_files)) {
-        /* does someone propose a certiciate to fall back on here? */
-        ap_ssl_add_fallback_cert_files(s, p, pks->cert_files, pks->key_files);
-        ssl_run_add_fallback_cert_files(s, p, pks->cert_files, pks->key_files);
-        if (n < pks->cert_files->nelts) {
-            pks->service_unavailable = 1;
-            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(10085)
-                         "Init: %s will respond with '503 Service Unavailable' for now. There "
-                         "are no SSL certificates configured and no other module contributed any.",
-                         ssl_util_vhostid(p, s));
-        }
-    }
-    
-    if (n < pks->cert_files->nelts) {
-        /* additionally installed certs overrides any old chain configuration */
-        sc->server->cert_chain = NULL;
-    }
-    
     if ((rv = ssl_init_ctx(s, p, ptemp, sc->server)) != APR_SUCCESS) {
         return rv;
     }
@@ -2136,6 +2668,39 @@ static apr_status_t ssl_init_server_ctx(server_rec *s,
     return APR_SUCCESS;
 }
 
+/*
+ * Allow others to provide certificate files for a server.  This runs for
+ * all servers before any of them is configured, so that the files can be
+ * preloaded.
+ */
+static void ssl_init_server_cert_files(server_rec *s, apr_pool_t *p,
+                                       SSLSrvConfigRec *sc)
+{
+    modssl_pk_server_t *pks = sc->server->pks;
+    int n = pks->cert_files->nelts;
+
+    ap_ssl_add_cert_files(s, p, pks->cert_files, pks->key_files);
+    ssl_run_add_cert_files(s, p, pks->cert_files, pks->key_files);
+
+    if (apr_is_empty_array(pks->cert_files)) {
+        /* does someone propose a certiciate to fall back on here? */
+        ap_ssl_add_fallback_cert_files(s, p, pks->cert_files, pks->key_files);
+        ssl_run_add_fallback_cert_files(s, p, pks->cert_files, pks->key_files);
+        if (n < pks->cert_files->nelts) {
+            pks->service_unavailable = 1;
+            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(10085)
+                         "Init: %s will respond with '503 Service Unavailable' for now. There "
+                         "are no SSL certificates configured and no other module contributed any.",
+                         ssl_util_vhostid(p, s));
+        }
+    }
+    
+    if (n < pks->cert_files->nelts) {
+        /* additionally installed certs overrides any old chain configuration */
+        sc->server->cert_chain = NULL;
+    }
+}
+
 /*
  * Configure a particular server
  */
@@ -30,6 +30,8 @@
 #include "ssl_private.h"
 
 #include "apr_date.h"
+#include "apr_poll.h"
+#include "apr_portable.h"
 
 APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(ssl, SSL, int, proxy_post_handshake,
                                     (conn_rec *c,SSL *ssl),
@@ -1153,6 +1155,69 @@ static apr_status_t ssl_io_filter_cleanup(void *data)
     return APR_SUCCESS;
 }
 
+#ifdef HAVE_SSL_ASYNC
+apr_status_t ssl_io_async_pollfds(SSL *ssl, apr_pool_t *p,
+                                  apr_array_header_t **pfds)
+{
+    OSSL_ASYNC_FD *fds;
+    size_t i, numfds = 0;
+
+    if (!SSL_get_all_async_fds(ssl, NULL, &numfds)) {
+        return APR_EGENERAL;
+    }
+    if (!numfds) {
+        return APR_EAGAIN;
+    }
+    fds = apr_palloc(p, numfds * sizeof(*fds));
+    if (!SSL_get_all_async_fds(ssl, fds, &numfds)) {
+        return APR_EGENERAL;
+    }
+
+    *pfds = apr_array_make(p, (int)numfds, sizeof(apr_pollfd_t));
+    for (i = 0; i < numfds; i++) {
+        apr_pollfd_t *pfd = apr_array_push(*pfds);
+        apr_os_file_t osfd = fds[i];
+        apr_status_t rv;
+
+        memset(pfd, 0, sizeof(*pfd));
+        pfd->p = p;
+        pfd->desc_type = APR_POLL_FILE;
+        pfd->reqevents = APR_POLLIN;
+        /* The fd belongs to the engine, apr_os_file_put() won't close it */
+        rv = apr_os_file_put(&pfd->desc.f, &osfd, APR_FOPEN_READ, p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+/* Wait in this thread for the paused async job of the handshake to be
+ * resumable, when the connection could not be parked in the MPM. */
+static apr_status_t ssl_io_async_wait(conn_rec *c, SSL *ssl)
+{
+    apr_array_header_t *pfds;
+    apr_int32_t nsds;
+    apr_status_t rv;
+    apr_pool_t *p;
+
+    apr_pool_create(&p, c->pool);
+    apr_pool_tag(p, "ssl_async_wait");
+    rv = ssl_io_async_pollfds(ssl, p, &pfds);
+    if (rv == APR_SUCCESS) {
+        rv = apr_poll((apr_pollfd_t *)pfds->elts, pfds->nelts, &nsds,
+                      c->base_server->timeout);
+    }
+    else if (APR_STATUS_IS_EAGAIN(rv)) {
+        /* No fd to wait for, the job can be resumed right away */
+        rv = APR_SUCCESS;
+    }
+    apr_pool_destroy(p);
+
+    return rv;
+}
+#endif
+
 /*
  * The hook is NOT registered with ap_hook_process_connection. Instead, it is
  * called manually from the churn () before it tries to read any data.
@@ -1400,12 +1465,39 @@ static apr_status_t ssl_io_filter_handshake(ssl_filter_ctx_t *filter_ctx)
         return APR_SUCCESS;
     }
 
+#ifdef HAVE_SSL_ASYNC
+    /* Let the private key operations of an async capable engine or
+     * provider pause the handshake rather than block in it.
+     */
+    if (myModConfig(c->base_server)->async_handshake == TRUE) {
+        SSL_set_mode(filter_ctx->pssl, SSL_MODE_ASYNC);
+    }
+#endif
+
     /* We rely on SSL_get_error() after the accept, which requires an empty
      * error queue before the accept in order to work properly.
      */
     ERR_clear_error();
+    n = SSL_accept(filter_ctx->pssl);
+
+#ifdef HAVE_SSL_ASYNC
+    while (n <= 0
+           && SSL_get_error(filter_ctx->pssl, n) == SSL_ERROR_WANT_ASYNC) {
+        if (sslconn->async_park) {
+            /* ssl_hook_process_connection() will suspend the connection
+             * until the job can make progress, and call us again.
+             */
+            return MODSSL_ERROR_WANT_ASYNC;
+        }
+        if (ssl_io_async_wait(c, filter_ctx->pssl) != APR_SUCCESS) {
+            break;
+        }
+        ERR_clear_error();
+        n = SSL_accept(filter_ctx->pssl);
+    }
+#endif
 
-    if ((n = SSL_accept(filter_ctx->pssl)) <= 0) {
+    if (n <= 0) {
         bio_filter_in_ctx_t *inctx = (bio_filter_in_ctx_t *)
                                      BIO_get_data(filter_ctx->pbioRead);
         bio_filter_out_ctx_t *outctx = (bio_filter_out_ctx_t *)
@@ -1464,6 +1556,10 @@ static apr_status_t ssl_io_filter_handshake(ssl_filter_ctx_t *filter_ctx)
         ssl_filter_io_shutdown(filter_ctx, c, 1);
         return inctx->rc;
     }
+#ifdef HAVE_SSL_ASYNC
+    /* Only the handshake runs as an async job, not the I/O to follow */
+    SSL_clear_mode(filter_ctx->pssl, SSL_MODE_ASYNC);
+#endif
     sc = mySrvConfig(sslconn->server);
 
     /*
@@ -35,7 +35,7 @@
 
 static void ssl_configure_env(request_rec *r, SSLConnRec *sslconn);
 #ifdef HAVE_TLSEXT
-static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s);
+static int ssl_set_vhost(conn_rec *c, server_rec *s);
 #endif
 
 #define SWITCH_STATUS_LINE "HTTP/1.1 101 Switching Protocols"
@@ -2410,8 +2410,9 @@ static apr_status_t init_vhost(conn_rec *c, SSL *ssl, const char *servername)
             servername = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
         }
         if (servername) {
-            if (ap_vhost_iterate_given_conn(c, ssl_find_vhost,
-                                            (void *)servername)) {
+            server_rec *s = ap_vhost_find_given_conn(c, servername);
+
+            if (s && ssl_set_vhost(c, s)) {
                 ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02043)
                               "SSL virtual host for servername %s found",
                               servername);
@@ -2524,22 +2525,19 @@ give_up:
 #endif /* OPENSSL_VERSION_NUMBER < 0x10101000L */
 
 /*
- * Find a (name-based) SSL virtual host where either the ServerName
- * or one of the ServerAliases matches the supplied name (to be used
- * with ap_vhost_iterate_given_conn())
+ * Switch the connection to the (name-based) SSL virtual host whose
+ * ServerName or one of the ServerAliases matches the SNI, as found by
+ * ap_vhost_find_given_conn()
  */
-static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s)
+static int ssl_set_vhost(conn_rec *c, server_rec *s)
 {
     SSLSrvConfigRec *sc;
     SSL *ssl;
-    BOOL found;
     SSLConnRec *sslcon;
 
-    found = ssl_util_vhost_matches(servername, s);
-
-    /* set SSL_CTX (if matched) */
+    /* set SSL_CTX */
     sslcon = myConnConfig(c);
-    if (found && (ssl = sslcon->ssl) &&
+    if ((ssl = sslcon->ssl) &&
         (sc = mySrvConfig(s))) {
         SSL_CTX *ctx = SSL_set_SSL_CTX(ssl, sc->server->ssl_ctx);
 
@@ -2619,10 +2617,91 @@ static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s)
 #endif /* HAVE_TLSEXT */
 
 #ifdef HAVE_TLS_SESSION_TICKETS
+/*
+ * Copy the rotated ticket key of the given period from the shared slots.
+ * The expired keys are wiped while other processes may be reading them,
+ * so the slot is checked again after the copy. The no-op compare-and-swaps
+ * are full barriers around the copy.
+ */
+static int ssl_ticket_key_get(modssl_ticket_keys_t *keys, apr_uint32_t period,
+                              unsigned char key[TLSEXT_TICKET_KEY_LEN])
+{
+    modssl_ticket_slot_t *slot = &keys->slots[period % MODSSL_TICKET_SLOTS];
+
+    if (!period || apr_atomic_cas32(&slot->period, period, period) != period) {
+        return 0;
+    }
+    memcpy(key, slot->key, TLSEXT_TICKET_KEY_LEN);
+    if (apr_atomic_cas32(&slot->period, period, period) != period) {
+        OPENSSL_cleanse(key, TLSEXT_TICKET_KEY_LEN);
+        return 0;
+    }
+    return 1;
+}
+
+static void ssl_ticket_key_wipe(modssl_ticket_slot_t *slot)
+{
+    apr_atomic_xchg32(&slot->period, 0);
+    OPENSSL_cleanse(slot->key, TLSEXT_TICKET_KEY_LEN);
+}
+
+static void ssl_ticket_key_create(modssl_ticket_slot_t *slot,
+                                  apr_uint32_t period)
+{
+    unsigned char key[TLSEXT_TICKET_KEY_LEN];
+
+    if (RAND_bytes(key, sizeof(key)) != 1) {
+        return;
+    }
+    key[12] = (unsigned char)(period >> 24);
+    key[13] = (unsigned char)(period >> 16);
+    key[14] = (unsigned char)(period >> 8);
+    key[15] = (unsigned char)period;
+
+    ssl_ticket_key_wipe(slot);
+    memcpy(slot->key, key, sizeof(key));
+    apr_atomic_xchg32(&slot->period, period);
+    OPENSSL_cleanse(key, sizeof(key));
+}
+
+/*
+ * Rotate the shared ticket keys to the given period. The first process
+ * to get there creates the key of the next period, and the one of this
+ * period too if nobody was around to prepare it, then wipes the key
+ * which expired. The processes of an older generation with another
+ * period length leave the keys alone.
+ */
+static void ssl_ticket_keys_rotate(modssl_ticket_keys_t *keys,
+                                   apr_uint32_t period, int rotation)
+{
+    apr_uint32_t rotated = apr_atomic_read32(&keys->rotated);
+    modssl_ticket_slot_t *slot;
+
+    if (keys->rotation != (apr_uint32_t)rotation || rotated == period
+        || apr_atomic_cas32(&keys->rotated, period, rotated) != rotated) {
+        return;
+    }
+
+    slot = &keys->slots[period % MODSSL_TICKET_SLOTS];
+    if (apr_atomic_read32(&slot->period) != period) {
+        ssl_ticket_key_create(slot, period);
+    }
+    slot = &keys->slots[(period + 1) % MODSSL_TICKET_SLOTS];
+    if (apr_atomic_read32(&slot->period) != period + 1) {
+        ssl_ticket_key_create(slot, period + 1);
+    }
+    /* Both period - 2 and period + 2 */
+    slot = &keys->slots[(period + 2) % MODSSL_TICKET_SLOTS];
+    if (apr_atomic_read32(&slot->period)) {
+        ssl_ticket_key_wipe(slot);
+    }
+}
+
 /*
  * This callback function is executed when OpenSSL needs a key for encrypting/
  * decrypting a TLS session ticket (RFC 5077) and a ticket key file has been
- * configured through SSLSessionTicketKeyFile.
+ * configured through SSLSessionTicketKeyFile, or the keys are rotated with
+ * SSLSessionTicketKeyRotation.
  */
 int ssl_callback_SessionTicket(SSL *ssl,
                                unsigned char *keyname,
@@ -2640,6 +2719,90 @@ int ssl_callback_SessionTicket(SSL *ssl,
     SSLSrvConfigRec *sc = mySrvConfig(s);
     modssl_ctx_t *mctx = myConnCtxConfig(c, sc);
     modssl_ticket_key_t *ticket_key = mctx->ticket_key;
+    unsigned char key[TLSEXT_TICKET_KEY_LEN];
+    const unsigned char *key_name, *aes_key;
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    const unsigned char *hmac_secret;
+#else
+    OSSL_PARAM key_params[3];
+    const OSSL_PARAM *mac_params;
+#endif
+    int rc = 1, i;
+
+    if (mode != 0 && mode != 1) {
+        /* OpenSSL is not expected to call us with modes other than 1 or 0 */
+        return -1;
+    }
+    if (ticket_key == NULL) {
+        /* should never happen, but better safe than sorry */
+        return mode ? -1 : 0;
+    }
+
+    if (ticket_key->rotation) {
+        modssl_ticket_keys_t *keys = ticket_key->keys;
+        apr_uint32_t period = (apr_uint32_t)(apr_time_sec(apr_time_now())
+                                             / ticket_key->rotation);
+
+        if (apr_atomic_read32(&keys->slots[(period + 1)
+                                           % MODSSL_TICKET_SLOTS].period)
+                != period + 1) {
+            ssl_ticket_keys_rotate(keys, period, ticket_key->rotation);
+        }
+        if (mode == 0) {
+            /* Accept the tickets of the previous period, and of the next
+             * one for processes which just rotated, but have them renewed
+             * (rc = 2) with the current key.
+             */
+            apr_uint32_t kperiod = 0;
+            for (i = 12; i < 16; ++i) {
+                kperiod = (kperiod << 8) | keyname[i];
+            }
+            if (kperiod + 1 < period || kperiod > period + 1) {
+                return 0;
+            }
+            if (kperiod != period) {
+                rc = 2;
+                period = kperiod;
+            }
+        }
+        for (i = 0; !ssl_ticket_key_get(keys, period, key); ++i) {
+            /* The key of the current period is missing only while
+             * another process creates it after an idle period.
+             */
+            if (mode == 0 || i == 10) {
+                return mode ? -1 : 0;
+            }
+            apr_sleep(apr_time_from_msec(1));
+        }
+        if (mode == 0 && CRYPTO_memcmp(keyname, key, 16)) {
+            OPENSSL_cleanse(key, sizeof(key));
+            return 0;
+        }
+        key_name = key;
+        aes_key = key + 32;
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+        hmac_secret = key + 16;
+#else
+        key_params[0] =
+            OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+                                              key + 16, 16);
+        key_params[1] =
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                             "sha256", 0);
+        key_params[2] =
+            OSSL_PARAM_construct_end();
+        mac_params = key_params;
+#endif
+    }
+    else {
+        key_name = ticket_key->key_name;
+        aes_key = ticket_key->aes_key;
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+        hmac_secret = ticket_key->hmac_secret;
+#else
+        mac_params = ticket_key->mac_params;
+#endif
+    }
 
     if (mode == 1) {
         /* 
@@ -2647,61 +2810,56 @@ int ssl_callback_SessionTicket(SSL *ssl,
          * see s3_srvr.c:ssl3_send_newsession_ticket()
          */
 
-        if (ticket_key == NULL) {
-            /* should never happen, but better safe than sorry */
-            return -1;
-        }
-
-        memcpy(keyname, ticket_key->key_name, 16);
+        memcpy(keyname, key_name, 16);
         if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
-            return -1;
+            rc = -1;
+            goto cleanup;
         }
         EVP_EncryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL,
-                           ticket_key->aes_key, iv);
+                           aes_key, iv);
 
 #if OPENSSL_VERSION_NUMBER < 0x30000000L
-        HMAC_Init_ex(hmac_ctx, ticket_key->hmac_secret, 16,
+        HMAC_Init_ex(hmac_ctx, hmac_secret, 16,
                      tlsext_tick_md(), NULL);
 #else
-        EVP_MAC_CTX_set_params(mac_ctx, ticket_key->mac_params);
+        EVP_MAC_CTX_set_params(mac_ctx, mac_params);
 #endif
 
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02289)
                       "TLS session ticket key for %s successfully set, "
                       "creating new session ticket", sc->vhost_id);
-
-        return 1;
     }
-    else if (mode == 0) {
+    else {
         /* 
          * OpenSSL is asking for the decryption key,
          * see t1_lib.c:tls_decrypt_ticket()
          */
 
         /* check key name */
-        if (ticket_key == NULL || memcmp(keyname, ticket_key->key_name, 16)) {
+        if (!ticket_key->rotation && memcmp(keyname, key_name, 16)) {
             return 0;
         }
 
         EVP_DecryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL,
-                           ticket_key->aes_key, iv);
+                           aes_key, iv);
 
 #if OPENSSL_VERSION_NUMBER < 0x30000000L
-        HMAC_Init_ex(hmac_ctx, ticket_key->hmac_secret, 16,
+        HMAC_Init_ex(hmac_ctx, hmac_secret, 16,
                      tlsext_tick_md(), NULL);
 #else
-        EVP_MAC_CTX_set_params(mac_ctx, ticket_key->mac_params);
+        EVP_MAC_CTX_set_params(mac_ctx, mac_params);
 #endif
 
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02290)
                       "TLS session ticket key for %s successfully set, "
                       "decrypting existing session ticket", sc->vhost_id);
-
-        return 1;
     }
 
-    /* OpenSSL is not expected to call us with modes other than 1 or 0 */
-    return -1;
+cleanup:
+    if (ticket_key->rotation) {
+        OPENSSL_cleanse(key, sizeof(key));
+    }
+    return rc;
 }
 #endif /* HAVE_TLS_SESSION_TICKETS */
 
@@ -294,6 +294,23 @@ void free_bio_methods(void);
 #define HAVE_OPENSSL_KEYLOG
 #endif
 
+/* OpenSSL >= 1.1.0 can run the handshake as an ASYNC_JOB, which pauses
+ * while an async capable engine or provider performs the private key
+ * operation; the job's wait fds are pollable on unix only. */
+#if defined(SSL_MODE_ASYNC) && !defined(OPENSSL_NO_ASYNC) \
+    && !defined(LIBRESSL_VERSION_NUMBER) && !defined(WIN32)
+#define HAVE_SSL_ASYNC
+#include <openssl/async.h>
+#endif
+
+/* Parsing certificate files in threads at startup (SSLStartupThreads)
+ * relies on the thread safe error queues of OpenSSL >= 1.1.0. */
+#if APR_HAS_THREADS && !MODSSL_USE_OPENSSL_PRE_1_1_API
+#define HAVE_SSL_STARTUP_THREADS
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
+#endif
+
 #ifdef HAVE_FIPS
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
 #define modssl_fips_is_enabled() EVP_default_properties_is_fips_enabled(NULL)
@@ -598,6 +615,13 @@ typedef struct {
     const char *cipher_suite; /* cipher suite used in last reneg */
     int service_unavailable;  /* thouugh we negotiate SSL, no requests will be served */
     int vhost_found;          /* whether we found vhost from SNI already */
+
+#ifdef HAVE_SSL_ASYNC
+    int async_park;           /* handshake may return MODSSL_ERROR_WANT_ASYNC */
+    int async_parked;         /* suspended until the async job can resume */
+    apr_pool_t *async_pool;   /* for the MPM's poll callback allocations */
+    apr_array_header_t *async_pfds; /* to poll once the MPM suspended us */
+#endif
 } SSLConnRec;
 
 /* Private keys are retained across reloads, since decryption
@@ -661,6 +685,7 @@ typedef struct {
     ap_socache_instance_t *stapling_cache_context;
     apr_global_mutex_t   *stapling_cache_mutex;
     apr_global_mutex_t   *stapling_refresh_mutex;
+    BOOL                  stapling_prefetch;
 #endif
 
 #ifdef HAVE_OPENSSL_KEYLOG
@@ -671,6 +696,14 @@ typedef struct {
 #ifdef HAVE_FIPS
     BOOL             fips;
 #endif
+
+#ifdef HAVE_SSL_ASYNC
+    BOOL             async_handshake;
+#endif
+
+#ifdef HAVE_SSL_STARTUP_THREADS
+    int              startup_threads;
+#endif
 } SSLModConfigRec;
 
 /** Structure representing configured filenames for certs and keys for
@@ -722,8 +755,34 @@ typedef struct {
 } modssl_auth_ctx_t;
 
 #ifdef HAVE_TLS_SESSION_TICKETS
+/* With SSLSessionTicketKeyRotation, the random keys of the periods around
+ * the current one live in memory shared by all the processes and retained
+ * across restarts. A key is laid out like the SSLSessionTicketKeyFile (key
+ * name, HMAC secret, AES key), with the period number at the end of the
+ * key name. The slot of a key is its period modulo MODSSL_TICKET_SLOTS, so
+ * the rotation to a period only writes slots which are not read during the
+ * periods before or after it. */
+#define MODSSL_TICKET_SLOTS 4
+
+typedef struct {
+    volatile apr_uint32_t period;   /* 0 while unset or being written */
+    unsigned char key[TLSEXT_TICKET_KEY_LEN];
+} modssl_ticket_slot_t;
+
+typedef struct {
+    apr_uint32_t rotation;          /* period length the keys are for */
+    volatile apr_uint32_t rotated;  /* last period claimed for rotation */
+    modssl_ticket_slot_t slots[MODSSL_TICKET_SLOTS];
+} modssl_ticket_keys_t;
+
+#define MODSSL_TICKET_KEYS_RETAINED_KEY "mod_ssl-ticket-keys-1"
+
 typedef struct {
     const char *file_path;
+    /* With a rotation period (in seconds), the keys are taken from
+     * the shared keys, the static ones below are unused then. */
+    int rotation;
+    modssl_ticket_keys_t *keys;
     unsigned char key_name[16];
 #if OPENSSL_VERSION_NUMBER < 0x30000000L
     unsigned char hmac_secret[16];
@@ -920,6 +979,7 @@ const char  *ssl_cmd_SSLProxyMachineCertificateFile(cmd_parms *, void *, const c
 const char  *ssl_cmd_SSLProxyMachineCertificateChainFile(cmd_parms *, void *, const char *);
 #ifdef HAVE_TLS_SESSION_TICKETS
 const char *ssl_cmd_SSLSessionTicketKeyFile(cmd_parms *cmd, void *dcfg, const char *arg);
+const char *ssl_cmd_SSLSessionTicketKeyRotation(cmd_parms *cmd, void *dcfg, const char *arg);
 #endif
 const char  *ssl_cmd_SSLProxyCheckPeerExpire(cmd_parms *cmd, void *dcfg, int flag);
 const char  *ssl_cmd_SSLProxyCheckPeerCN(cmd_parms *cmd, void *dcfg, int flag);
@@ -949,6 +1009,8 @@ const char *ssl_cmd_SSLSRPUnknownUserSeed(cmd_parms *cmd, void *dcfg, const char
 #endif
 
 const char *ssl_cmd_SSLFIPS(cmd_parms *cmd, void *dcfg, int flag);
+const char *ssl_cmd_SSLStartupThreads(cmd_parms *cmd, void *dcfg, const char *arg);
+const char *ssl_cmd_SSLAsyncHandshake(cmd_parms *cmd, void *dcfg, int flag);
 
 /**  module initialization  */
 apr_status_t ssl_init_Module(apr_pool_t *, apr_pool_t *, apr_pool_t *, server_rec *);
@@ -1033,8 +1095,10 @@ const char *ssl_cmd_SSLStaplingReturnResponderErrors(cmd_parms *, void *, int);
 const char *ssl_cmd_SSLStaplingFakeTryLater(cmd_parms *, void *, int);
 const char *ssl_cmd_SSLStaplingResponderTimeout(cmd_parms *, void *, const char *);
 const char *ssl_cmd_SSLStaplingForceURL(cmd_parms *, void *, const char *);
+const char *ssl_cmd_SSLStaplingPrefetch(cmd_parms *, void *, int);
 apr_status_t modssl_init_stapling(server_rec *, apr_pool_t *, apr_pool_t *, modssl_ctx_t *);
 void         ssl_stapling_certinfo_hash_init(apr_pool_t *);
+apr_status_t ssl_stapling_prefetch_init(server_rec *, apr_pool_t *);
 int          ssl_stapling_init_cert(server_rec *, apr_pool_t *, apr_pool_t *,
                                     modssl_ctx_t *, X509 *);
 #endif
@@ -1050,6 +1114,18 @@ void         modssl_callback_keylog(const SSL *ssl, const char *line);
 /**  I/O  */
 apr_status_t ssl_io_filter_init(conn_rec *, request_rec *r, SSL *);
 void         ssl_io_filter_register(apr_pool_t *);
+
+#ifdef HAVE_SSL_ASYNC
+/* Custom apr_status_t error code, returned by the handshake when
+ * SSLConnRec.async_park is set and the async job is paused, such that
+ * the caller can suspend the connection on ssl_io_async_pollfds(). */
+#define MODSSL_ERROR_WANT_ASYNC (APR_OS_START_USERERR + 2)
+
+/* Fill *pfds with the fds to poll for the paused async job of ssl,
+ * APR_EAGAIN if there is none (the job can be resumed right away). */
+apr_status_t ssl_io_async_pollfds(SSL *ssl, apr_pool_t *p,
+                                  apr_array_header_t **pfds);
+#endif
 void         modssl_set_io_callbacks(SSL *ssl);
 
 /* ssl_io_buffer_fill fills the setaside buffering of the HTTP request
@@ -1179,11 +1255,13 @@ int modssl_verify_ocsp(X509_STORE_CTX *ctx, SSLSrvConfigRec *sc,
 /* OCSP helper interface; dispatches the given OCSP request to the
  * responder at the given URI.  Returns the decoded OCSP response
  * object, or NULL on error (in which case, errors will have been
- * logged).  Pool 'p' is used for temporary allocations. */
+ * logged against server 's').  Pool 'p' is used for temporary
+ * allocations.  No connection is needed, so this may be called outside
+ * of a handshake. */
 OCSP_RESPONSE *modssl_dispatch_ocsp_request(const apr_uri_t *uri,
                                             apr_interval_time_t timeout,
                                             OCSP_REQUEST *request,
-                                            conn_rec *c, apr_pool_t *p);
+                                            server_rec *s, apr_pool_t *p);
 
 /* Initialize OCSP trusted certificate list */
 void ssl_init_ocsp_certificates(server_rec *s, modssl_ctx_t *mctx);
@@ -31,7 +31,9 @@
 #include "ssl_private.h"
 
 #include "ap_mpm.h"
+#include "apr_atomic.h"
 #include "apr_thread_mutex.h"
+#include "mod_watchdog.h"
 
 APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(ssl, SSL, int, init_stapling_status,
                                     (server_rec *s, apr_pool_t *p, 
@@ -62,14 +64,92 @@ static int stapling_cb(SSL *ssl, void *arg);
 
 #define MAX_STAPLING_DER 10240
 
+/**
+ * How long a response retrieved from the stapling cache is served from
+ * process memory before the cache is consulted again.
+ */
+#define STAPLING_MEM_TTL apr_time_from_sec(60)
+
+/**
+ * Cache entries start with a flag whether the response was valid when
+ * stored and the time the entry expires (8 bytes, big endian), so that
+ * the copy kept in process memory never outlives the cache entry.
+ * Entries of the older format without the expiry may remain in a
+ * persistent cache, so the cache key (the certificate's index) is
+ * followed by a format version which they don't have.
+ */
+#define STAPLING_HDR_LEN 9
+#define STAPLING_KEY_VERSION 2
+#define STAPLING_KEY_LEN (SHA_DIGEST_LENGTH + 1)
+
+static void stapling_expiry_put(unsigned char *p, apr_time_t expiry)
+{
+    int i;
+
+    for (i = 7; i >= 0; --i) {
+        p[i] = (unsigned char)(expiry & 0xff);
+        expiry >>= 8;
+    }
+}
+
+static apr_time_t stapling_expiry_get(const unsigned char *p)
+{
+    apr_uint64_t expiry = 0;
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        expiry = (expiry << 8) | p[i];
+    }
+    return (apr_time_t)expiry;
+}
+
+/**
+ * How often the SSLStaplingPrefetch watchdog looks for responses that
+ * are due for renewal.
+ */
+#define STAPLING_PREFETCH_INTERVAL apr_time_from_sec(5)
+#define STAPLING_PREFETCH_WATCHDOG "_ssl_stapling_"
+
+/*
+ * Per-process copy of the cached response for a certificate, in the same
+ * format as the stapling cache entry (header + DER response).  It is
+ * read without any lock: a writer moves 'seq' to an odd value, updates
+ * the entry, then moves 'seq' to the next even value.  A reader which
+ * sees an odd or changed 'seq' around its copy discards it.
+ *
+ * The copy is allocated when the first response is seen, sized after
+ * it.  A larger response gets a new copy, the smaller ones may still be
+ * read by other threads and are only freed with the certinfo.
+ */
+typedef struct stapling_mem stapling_mem;
+struct stapling_mem {
+    volatile apr_uint32_t seq;
+    apr_time_t expires;
+    apr_size_t len;
+    apr_size_t size;            /* of der[] */
+    stapling_mem *prev;
+    UCHAR der[1];
+};
+
+#define STAPLING_MEM_ALIGN 1024
+
 /* Cached info stored in the global stapling_certinfo hash. */
 typedef struct {
-    /* Index in session cache (SHA-1 digest of DER encoded certificate) */
-    UCHAR idx[SHA_DIGEST_LENGTH];
+    /* Index in session cache (SHA-1 digest of DER encoded certificate),
+     * followed by STAPLING_KEY_VERSION */
+    UCHAR idx[STAPLING_KEY_LEN];
     /* Certificate ID for OCSP request */
     OCSP_CERTID *cid;
     /* URI of the OCSP responder */
     char *uri;
+    /* Last response seen by this process, if any */
+    stapling_mem *volatile mem;
+    /* First server and context the certificate was configured for,
+     * used by the prefetch watchdog */
+    server_rec *s;
+    modssl_ctx_t *mctx;
+    /* When the prefetch watchdog renews the response next */
+    apr_time_t renew_at;
 } certinfo;
 
 static apr_status_t ssl_stapling_certid_free(void *data)
@@ -83,6 +163,19 @@ static apr_status_t ssl_stapling_certid_free(void *data)
     return APR_SUCCESS;
 }
 
+static apr_status_t stapling_mem_free(void *data)
+{
+    certinfo *cinf = data;
+    stapling_mem *mem = cinf->mem, *prev;
+
+    for (; mem; mem = prev) {
+        prev = mem->prev;
+        free(mem);
+    }
+    cinf->mem = NULL;
+    return APR_SUCCESS;
+}
+
 static apr_hash_t *stapling_certinfo;
 
 void ssl_stapling_certinfo_hash_init(apr_pool_t *p)
@@ -216,10 +309,16 @@ int ssl_stapling_init_cert(server_rec *s, apr_pool_t *p, apr_pool_t *ptemp,
     /* At this point, we have determined that there's something to store */
     cinf = apr_pcalloc(p, sizeof(certinfo));
     memcpy (cinf->idx, idx, sizeof(idx));
+    cinf->idx[SHA_DIGEST_LENGTH] = STAPLING_KEY_VERSION;
     cinf->cid = cid;
-    /* make sure cid is also freed at pool cleanup */
+    cinf->s = s;
+    cinf->mctx = mctx;
+    /* make sure cid and the response copies are also freed at pool
+     * cleanup */
     apr_pool_cleanup_register(p, cid, ssl_stapling_certid_free,
                               apr_pool_cleanup_null);
+    apr_pool_cleanup_register(p, cinf, stapling_mem_free,
+                              apr_pool_cleanup_null);
     if (aia) {
        /* allocate uri from the pconf pool */
        cinf->uri = apr_pstrdup(p, sk_OPENSSL_STRING_value(aia, 0));
@@ -230,7 +329,7 @@ int ssl_stapling_init_cert(server_rec *s, apr_pool_t *p, apr_pool_t *ptemp,
                    "ssl_stapling_init_cert: storing certinfo for server %s",
                    mctx->sc->vhost_id);
 
-    apr_hash_set(stapling_certinfo, cinf->idx, sizeof(cinf->idx), cinf);
+    apr_hash_set(stapling_certinfo, cinf->idx, SHA_DIGEST_LENGTH, cinf);
 
 cleanup:
     X509_free(issuer);
@@ -249,6 +348,100 @@ static certinfo *stapling_get_certinfo(server_rec *s, UCHAR *idx, apr_size_t idx
     return NULL;
 }
 
+/*
+ * apr_atomic_read32() is a plain load with some APR versions, the no-op
+ * compare-and-swap gives the full barrier a seqlock reader needs.
+ */
+static APR_INLINE apr_uint32_t stapling_mem_seq(stapling_mem *mem)
+{
+    apr_uint32_t seq = apr_atomic_read32(&mem->seq);
+
+    return apr_atomic_cas32(&mem->seq, seq, seq);
+}
+
+/*
+ * Update the per-process copy of a response; a 'len' of zero drops it.
+ * If another thread is updating the entry at the same time, leave it
+ * to that thread.
+ */
+static void stapling_mem_store(certinfo *cinf, const UCHAR *der,
+                               apr_size_t len, apr_time_t expires)
+{
+    stapling_mem *mem, *grown;
+    apr_uint32_t seq;
+
+    mem = apr_atomic_casptr((volatile void **)&cinf->mem, NULL, NULL);
+    if (!mem || len > mem->size) {
+        if (!len || len > MAX_STAPLING_DER) {
+            return;
+        }
+        grown = malloc(APR_OFFSETOF(stapling_mem, der)
+                       + APR_ALIGN(len, STAPLING_MEM_ALIGN));
+        if (!grown) {
+            return;
+        }
+        grown->seq = 0;
+        grown->expires = expires;
+        grown->len = len;
+        grown->size = APR_ALIGN(len, STAPLING_MEM_ALIGN);
+        grown->prev = mem;
+        memcpy(grown->der, der, len);
+        if (apr_atomic_casptr((volatile void **)&cinf->mem,
+                              grown, mem) != mem) {
+            free(grown);
+        }
+        return;
+    }
+
+    seq = apr_atomic_read32(&mem->seq);
+    if ((seq & 1) || apr_atomic_cas32(&mem->seq, seq + 1, seq) != seq) {
+        return;
+    }
+    mem->expires = len ? expires : 0;
+    mem->len = len;
+    if (len) {
+        memcpy(mem->der, der, len);
+    }
+    apr_atomic_inc32(&mem->seq);
+}
+
+/*
+ * Copy the per-process copy of a response into 'der' (which must hold
+ * MAX_STAPLING_DER bytes).  Returns the length copied, or zero if there
+ * is no current entry.
+ */
+static apr_size_t stapling_mem_load(certinfo *cinf, UCHAR *der,
+                                    apr_time_t now)
+{
+    stapling_mem *mem;
+    apr_uint32_t seq;
+    apr_size_t len;
+    int tries;
+
+    mem = apr_atomic_casptr((volatile void **)&cinf->mem, NULL, NULL);
+    if (!mem) {
+        return 0;
+    }
+    for (tries = 0; tries < 3; tries++) {
+        seq = stapling_mem_seq(mem);
+        if (seq & 1) {
+            continue;
+        }
+        if (mem->expires <= now) {
+            return 0;
+        }
+        len = mem->len;
+        if (len > mem->size) {
+            continue;
+        }
+        memcpy(der, mem->der, len);
+        if (stapling_mem_seq(mem) == seq) {
+            return len;
+        }
+    }
+    return 0;
+}
+
 /*
  * OCSP response caching code. The response is preceded by a flag value
  * which indicates whether the response was invalid when it was stored.
@@ -264,7 +457,7 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
                                     BOOL ok, apr_pool_t *pool)
 {
     SSLModConfigRec *mc = myModConfig(s);
-    unsigned char resp_der[MAX_STAPLING_DER]; /* includes one-byte flag + response */
+    unsigned char resp_der[MAX_STAPLING_DER]; /* includes header + response */
     unsigned char *p;
     int resp_derlen, stored_len;
     BOOL rv;
@@ -278,7 +471,7 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
         return FALSE;
     }
 
-    stored_len = resp_derlen + 1; /* response + ok flag */
+    stored_len = resp_derlen + STAPLING_HDR_LEN; /* response + ok flag + expiry */
     if (stored_len > sizeof resp_der) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01928)
                      "OCSP stapling response too big (%u bytes)", resp_derlen);
@@ -298,6 +491,8 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
     }
 
     expiry += apr_time_now();
+    stapling_expiry_put(p, expiry);
+    p += 8;
 
     i2d_OCSP_RESPONSE(rsp, &p);
 
@@ -313,6 +508,7 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
                      "stapling_cache_response: OCSP response session store error!");
         return FALSE;
     }
+    stapling_mem_store(cinf, resp_der, stored_len, expiry);
 
     return TRUE;
 }
@@ -326,23 +522,36 @@ static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
     OCSP_RESPONSE *rsp;
     unsigned char resp_der[MAX_STAPLING_DER];
     const unsigned char *p;
-    unsigned int resp_derlen = MAX_STAPLING_DER;
-
-    if (mc->stapling_cache->flags & AP_SOCACHE_FLAG_NOTMPSAFE)
-        stapling_cache_mutex_on(s);
-    rv = mc->stapling_cache->retrieve(mc->stapling_cache_context, s,
-                                      cinf->idx, sizeof(cinf->idx),
-                                      resp_der, &resp_derlen, pool);
-    if (mc->stapling_cache->flags & AP_SOCACHE_FLAG_NOTMPSAFE)
-        stapling_cache_mutex_off(s);
-    if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01930)
-                     "stapling_get_cached_response: cache miss");
-        return;
+    unsigned int resp_derlen;
+    apr_time_t now = apr_time_now(), expiry;
+
+    resp_derlen = (unsigned int)stapling_mem_load(cinf, resp_der, now);
+    if (!resp_derlen) {
+        resp_derlen = MAX_STAPLING_DER;
+        if (mc->stapling_cache->flags & AP_SOCACHE_FLAG_NOTMPSAFE)
+            stapling_cache_mutex_on(s);
+        rv = mc->stapling_cache->retrieve(mc->stapling_cache_context, s,
+                                          cinf->idx, sizeof(cinf->idx),
+                                          resp_der, &resp_derlen, pool);
+        if (mc->stapling_cache->flags & AP_SOCACHE_FLAG_NOTMPSAFE)
+            stapling_cache_mutex_off(s);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01930)
+                         "stapling_get_cached_response: cache miss");
+            return;
+        }
+        if (resp_derlen > STAPLING_HDR_LEN) {
+            /* keep it no longer than the cache does */
+            expiry = stapling_expiry_get(resp_der + 1);
+            if (expiry > now + STAPLING_MEM_TTL) {
+                expiry = now + STAPLING_MEM_TTL;
+            }
+            stapling_mem_store(cinf, resp_der, resp_derlen, expiry);
+        }
     }
-    if (resp_derlen <= 1) {
-        /* should-not-occur; must have at least valid-when-stored flag +
-         * OCSPResponseStatus
+    if (resp_derlen <= STAPLING_HDR_LEN) {
+        /* should-not-occur; must have at least valid-when-stored flag,
+         * expiry + OCSPResponseStatus
          */
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01931)
                      "stapling_get_cached_response: response length invalid??");
@@ -353,8 +562,8 @@ static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
         *pok = TRUE;
     else
         *pok = FALSE;
-    p++;
-    resp_derlen--;
+    p += STAPLING_HDR_LEN;
+    resp_derlen -= STAPLING_HDR_LEN;
     rsp = d2i_OCSP_RESPONSE(NULL, &p, resp_derlen);
     if (!rsp) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01932)
@@ -472,15 +681,17 @@ static int stapling_check_response(server_rec *s, modssl_ctx_t *mctx,
     return rv;
 }
 
+/* Query the responder and cache the result.  'ssl' is the handshake the
+ * query is made for, if any; its status request extensions are passed
+ * on to the responder. */
 static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
                                     certinfo *cinf, OCSP_RESPONSE **prsp,
                                     BOOL *pok, apr_pool_t *pool)
 {
-    conn_rec *conn      = (conn_rec *)SSL_get_app_data(ssl);
     apr_pool_t *vpool;
     OCSP_REQUEST *req = NULL;
     OCSP_CERTID *id = NULL;
-    STACK_OF(X509_EXTENSION) *exts;
+    STACK_OF(X509_EXTENSION) *exts = NULL;
     int i;
     BOOL rv = FALSE;
     const char *ocspuri;
@@ -501,7 +712,9 @@ static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
         goto err;
     id = NULL;
     /* Add any extensions to the request */
-    SSL_get_tlsext_status_exts(ssl, &exts);
+    if (ssl) {
+        SSL_get_tlsext_status_exts(ssl, &exts);
+    }
     for (i = 0; i < sk_X509_EXTENSION_num(exts); i++) {
         X509_EXTENSION *ext = sk_X509_EXTENSION_value(exts, i);
         if (!OCSP_REQUEST_add_ext(req, ext, -1)) 
@@ -520,7 +733,7 @@ static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
     }
 
     /* Create a temporary pool to constrain memory use */
-    apr_pool_create(&vpool, conn->pool);
+    apr_pool_create(&vpool, pool);
     apr_pool_tag(vpool, "modssl_stapling_renew");
 
     if (apr_uri_parse(vpool, ocspuri, &uri) != APR_SUCCESS) {
@@ -542,7 +755,7 @@ static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
     }
 
     *prsp = modssl_dispatch_ocsp_request(&uri, mctx->stapling_responder_timeout,
-                                         req, conn, vpool);
+                                         req, s, vpool);
 
     apr_pool_destroy(vpool);
 
@@ -759,6 +972,7 @@ static int get_and_check_cached_response(server_rec *s, modssl_ctx_t *mctx,
             if (ok) {
                 OCSP_RESPONSE_free(*rsp);
                 *rsp = NULL;
+                stapling_mem_store(cinf, NULL, 0, 0);
             }
             else if (!mctx->stapling_return_errors) {
                 OCSP_RESPONSE_free(*rsp);
@@ -858,7 +1072,14 @@ static int stapling_cb(SSL *ssl, void *arg)
         return rv;
     }
 
-    if (rsp == NULL) {
+    if (rsp == NULL && myModConfig(s)->stapling_prefetch == TRUE) {
+        /* Never wait for the responder here; the prefetch watchdog
+         * will provide a response for later handshakes. */
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10475)
+                     "stapling_cb: no cached response, leaving renewal "
+                     "to the prefetch watchdog");
+    }
+    else if (rsp == NULL) {
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01954)
                      "stapling_cb: renewing cached response");
         stapling_refresh_mutex_on(s);
@@ -920,6 +1141,98 @@ static int stapling_cb(SSL *ssl, void *arg)
     return rv;
 }
 
+/*
+ * SSLStaplingPrefetch: renew the responses of all certificates from a
+ * watchdog well before they expire from the stapling cache, so that
+ * handshakes find them there.
+ */
+static apr_status_t stapling_prefetch_cb(int state, void *data,
+                                         apr_pool_t *pool)
+{
+    server_rec *base_server = data;
+    apr_hash_index_t *hi;
+    void *val;
+    certinfo *cinf;
+    OCSP_RESPONSE *rsp;
+    BOOL ok;
+    int timeout;
+
+    if (state == AP_WATCHDOG_STATE_STOPPING) {
+        return APR_SUCCESS;
+    }
+
+    for (hi = apr_hash_first(pool, stapling_certinfo); hi;
+         hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, &val);
+        cinf = val;
+        if (cinf->renew_at > apr_time_now()) {
+            continue;
+        }
+
+        rsp = NULL;
+        ok = FALSE;
+        if (stapling_renew_response(cinf->s, cinf->mctx, NULL, cinf,
+                                    &rsp, &ok, pool) == FALSE) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, cinf->s,
+                         APLOGNO(10476) "stapling_prefetch: error renewing "
+                         "response for server %s", cinf->mctx->sc->vhost_id);
+        }
+        OCSP_RESPONSE_free(rsp); /* NULL safe */
+
+        /* Renew again once three quarters of the cache lifetime passed */
+        timeout = ok ? cinf->mctx->stapling_cache_timeout
+                     : cinf->mctx->stapling_errcache_timeout;
+        cinf->renew_at = apr_time_now()
+                         + apr_time_from_sec(timeout - timeout / 4);
+    }
+    ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, base_server,
+                 "stapling_prefetch: checked %u certificate(s)",
+                 apr_hash_count(stapling_certinfo));
+
+    return APR_SUCCESS;
+}
+
+apr_status_t ssl_stapling_prefetch_init(server_rec *s, apr_pool_t *p)
+{
+    SSLModConfigRec *mc = myModConfig(s);
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_get_instance) *wd_get_instance;
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_register_callback) *wd_register_callback;
+    ap_watchdog_t *watchdog;
+    apr_status_t rv;
+
+    if (mc->stapling_prefetch != TRUE
+        || apr_hash_count(stapling_certinfo) == 0) {
+        return APR_SUCCESS;
+    }
+
+    wd_get_instance = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_get_instance);
+    wd_register_callback = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_register_callback);
+    if (!wd_get_instance || !wd_register_callback) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(10477)
+                     "SSLStaplingPrefetch: mod_watchdog is not loaded, "
+                     "responses will be renewed during handshakes");
+        mc->stapling_prefetch = FALSE;
+        return APR_SUCCESS;
+    }
+
+    rv = wd_get_instance(&watchdog, STAPLING_PREFETCH_WATCHDOG, 0, 1, p);
+    if (rv == APR_SUCCESS) {
+        rv = wd_register_callback(watchdog, STAPLING_PREFETCH_INTERVAL, s,
+                                  stapling_prefetch_cb);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(10478)
+                     "SSLStaplingPrefetch: cannot set up watchdog");
+        return rv;
+    }
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10479)
+                 "SSLStaplingPrefetch: renewing responses for %u "
+                 "certificate(s) in the background",
+                 apr_hash_count(stapling_certinfo));
+
+    return APR_SUCCESS;
+}
+
 apr_status_t modssl_init_stapling(server_rec *s, apr_pool_t *p,
                                   apr_pool_t *ptemp, modssl_ctx_t *mctx)
 {
@@ -966,16 +966,6 @@ cleanup:
     return rv;
 }
 
-static int find_vhost(void *sni_hostname, conn_rec *c, server_rec *s)
-{
-    if (tls_util_name_matches_server(sni_hostname, s)) {
-        tls_conf_conn_t *cc = tls_conf_conn_get(c);
-        cc->server = s;
-        return 1;
-    }
-    return 0;
-}
-
 static apr_status_t select_application_protocol(
     conn_rec *c, server_rec *s, rustls_server_config_builder *builder)
 {
@@ -1193,7 +1183,10 @@ apr_status_t tls_core_conn_seen_client_hello(conn_rec *c)
     if (!cc->client_hello_seen) goto cleanup;
 
     if (cc->sni_hostname) {
-        if (ap_vhost_iterate_given_conn(c, find_vhost, (void*)cc->sni_hostname)) {
+        server_rec *s = ap_vhost_find_given_conn(c, cc->sni_hostname);
+
+        if (s) {
+            cc->server = s;
             ap_log_cerror(APLOG_MARK, APLOG_DEBUG, rv, c, APLOGNO(10337)
                 "vhost_init: virtual host found for SNI '%s'", cc->sni_hostname);
             sni_match = 1;
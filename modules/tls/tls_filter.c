@@ -604,8 +604,10 @@ static apr_status_t fout_pass_rustls_to_tls(tls_filter_ctx_t *fctx)
             while (rustls_connection_wants_write(fctx->cc->rustls_connection));
             ap_log_cerror(APLOG_MARK, APLOG_TRACE3, rv, fctx->c,
                 "fout_pass_rustls_to_tls, %ld bytes ready for network", (long)fctx->fout_bytes_in_tls_bb);
-            fctx->fout_bytes_in_rustls = 0;
         }
+        /* rustls has no more plain data buffered, in either mode. Not resetting
+         * this makes every following write drain rustls on its own. */
+        fctx->fout_bytes_in_rustls = 0;
     }
 cleanup:
     return rv;
@@ -735,6 +737,17 @@ cleanup:
     return rv;
 }
 
+#define TLS_FILE_CHUNK_SIZE  4 * TLS_PREF_PLAIN_CHUNK_SIZE
+
+static const char *fout_file_buf(tls_filter_ctx_t *fctx)
+{
+    /* Allocated on first use only, most connections never send files. */
+    if (!fctx->fout_buf_file) {
+        fctx->fout_buf_file = apr_palloc(fctx->c->pool, TLS_FILE_CHUNK_SIZE);
+    }
+    return fctx->fout_buf_file;
+}
+
 static apr_status_t fout_append_plain(tls_filter_ctx_t *fctx, apr_bucket *b)
 {
     const char *data;
@@ -788,13 +801,12 @@ static apr_status_t fout_append_plain(tls_filter_ctx_t *fctx, apr_bucket *b)
         else {
             /* we have a large chunk and our plain buffer is empty, write it
              * directly into rustls. */
-#define TLS_FILE_CHUNK_SIZE  4 * TLS_PREF_PLAIN_CHUNK_SIZE
             if (b->length > TLS_FILE_CHUNK_SIZE) {
                 apr_bucket_split(b, TLS_FILE_CHUNK_SIZE);
             }
 
             if (APR_BUCKET_IS_FILE(b)
-                && (lbuf = malloc(b->length))) {
+                && (lbuf = fout_file_buf(fctx))) {
                 /* A file bucket is a most wonderous thing. Since the dawn of time,
                  * it has been subject to many optimizations for efficient handling
                  * of large data in the server:
@@ -815,7 +827,8 @@ static apr_status_t fout_append_plain(tls_filter_ctx_t *fctx, apr_bucket *b)
                  * that fit what it wants to assemble already, its work is much easier.
                  *
                  * We can read file buckets in large chunks than APR_BUCKET_BUFF_SIZE,
-                 * with a bit of knowledge about how they work.
+                 * with a bit of knowledge about how they work. The buffer we read
+                 * into belongs to the connection and is reused for all chunks.
                  */
                 apr_bucket_file *f = (apr_bucket_file *)b->data;
                 apr_file_t *fd = f->fd;
@@ -847,7 +860,6 @@ maybe_flush:
     }
 
 cleanup:
-    if (lbuf) free((void*)lbuf);
     if (rr != RUSTLS_RESULT_OK) {
         const char *err_descr = "";
         rv = tls_core_error(fctx->c, rr, &err_descr);
@@ -961,7 +973,8 @@ int tls_filter_pre_conn_init(conn_rec *c)
     fctx->fin_plain_bb = apr_brigade_create(c->pool, c->bucket_alloc);
     fctx->fout_ctx = ap_add_output_filter(TLS_FILTER_RAW, fctx, NULL, c);
     fctx->fout_tls_bb = apr_brigade_create(c->pool, c->bucket_alloc);
-    fctx->fout_buf_plain_size = APR_BUCKET_BUFF_SIZE;
+    /* Collect small writes until they fill a maximum sized TLS record. */
+    fctx->fout_buf_plain_size = TLS_PREF_PLAIN_CHUNK_SIZE;
     fctx->fout_buf_plain = apr_pcalloc(c->pool, fctx->fout_buf_plain_size);
     fctx->fout_buf_plain_len = 0;
 
@@ -35,6 +35,7 @@ struct tls_filter_ctx_t {
     char *fout_buf_plain;                /* a buffer to collect plain bytes for output */
     apr_size_t fout_buf_plain_len;       /* the amount of bytes in the buffer */
     apr_size_t fout_buf_plain_size;      /* the total size of the buffer */
+    char *fout_buf_file;                 /* a buffer to read file chunks into, lazily allocated */
     apr_bucket_brigade *fout_tls_bb;     /* TLS encrypted, outgoing network data */
     apr_off_t fout_bytes_in_rustls;      /* # of output plain bytes in rustls_connection */
     apr_off_t fout_bytes_in_tls_bb;      /* # of output tls bytes in our brigade */
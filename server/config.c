@@ -34,6 +34,11 @@
 #include "apr_portable.h"
 #include "apr_file_io.h"
 #include "apr_fnmatch.h"
+#include "apr_hash.h"
+#if APR_HAS_THREADS
+#include "apr_thread_rwlock.h"
+#include "apr_thread_mutex.h"
+#endif
 
 #define APR_WANT_STDIO
 #define APR_WANT_STRFUNC
@@ -245,6 +250,31 @@ typedef void *(*merger_func)(apr_pool_t *, void *, void *);
  */
 static merger_func *merger_func_cache;
 
+/* Per-dir merge results shared by all requests of a child process, see
+ * ap_merge_per_dir_configs_shared(). Set up at post_config, so it is only
+ * used once the configuration is complete, and gone with pconf. Entries
+ * are merged one after the other into the cache pool, under a mutex of
+ * their own, so an entry costs no more than its merged configs. The
+ * number of entries is set with DirMergeCache, 0 disables the cache.
+ */
+#ifndef AP_MERGE_CACHE_MAX
+#define AP_MERGE_CACHE_MAX (1024)
+#endif
+
+typedef struct {
+    ap_conf_vector_t *base;
+    ap_conf_vector_t *new_conf;
+} merge_cache_key;
+
+static int merge_cache_max = AP_MERGE_CACHE_MAX;
+static apr_pool_t *merge_cache_pool;
+static apr_hash_t *merge_cache;
+static volatile int merge_cache_full;
+#if APR_HAS_THREADS
+static apr_thread_rwlock_t *merge_cache_lock;
+static apr_thread_mutex_t *merge_cache_mutex;
+#endif
+
 /* maximum nesting level for config directories */
 #ifndef AP_MAX_INCLUDE_DIR_DEPTH
 #define AP_MAX_INCLUDE_DIR_DEPTH (128)
@@ -308,6 +338,97 @@ AP_CORE_DECLARE(ap_conf_vector_t *) ap_merge_per_dir_configs(apr_pool_t *p,
     return (ap_conf_vector_t *)conf_vector;
 }
 
+static ap_conf_vector_t *merge_cache_get(const merge_cache_key *key)
+{
+    return apr_hash_get(merge_cache, key, sizeof(*key));
+}
+
+AP_CORE_DECLARE(void) ap_set_merge_cache_size(int entries)
+{
+    merge_cache_max = entries;
+}
+
+AP_CORE_DECLARE(ap_conf_vector_t *) ap_merge_per_dir_configs_shared(
+                                           apr_pool_t *p,
+                                           ap_conf_vector_t *base,
+                                           ap_conf_vector_t *new_conf,
+                                           int *shared)
+{
+    merge_cache_key key, *pkey;
+    ap_conf_vector_t *merged, *found;
+
+    if (!merge_cache) {
+        goto unshared;
+    }
+    key.base = base;
+    key.new_conf = new_conf;
+
+#if APR_HAS_THREADS
+    if (merge_cache_lock) {
+        apr_thread_rwlock_rdlock(merge_cache_lock);
+    }
+#endif
+    found = merge_cache_get(&key);
+#if APR_HAS_THREADS
+    if (merge_cache_lock) {
+        apr_thread_rwlock_unlock(merge_cache_lock);
+    }
+#endif
+    if (found) {
+        *shared = 1;
+        return found;
+    }
+    if (merge_cache_full) {
+        goto unshared;
+    }
+
+    /* Merge under the cache mutex, which only the misses take, so the
+     * readers are blocked just while the entry is inserted. All the
+     * inserts happen under the mutex, so the hash can be searched again
+     * without the lock, a thread which waited for the same pair finds
+     * the entry.
+     */
+#if APR_HAS_THREADS
+    if (merge_cache_mutex) {
+        apr_thread_mutex_lock(merge_cache_mutex);
+    }
+#endif
+    found = merge_cache_get(&key);
+    if (!found && !merge_cache_full) {
+        merged = ap_merge_per_dir_configs(merge_cache_pool, base, new_conf);
+        pkey = apr_pmemdup(merge_cache_pool, &key, sizeof(key));
+#if APR_HAS_THREADS
+        if (merge_cache_lock) {
+            apr_thread_rwlock_wrlock(merge_cache_lock);
+        }
+#endif
+        apr_hash_set(merge_cache, pkey, sizeof(*pkey), merged);
+#if APR_HAS_THREADS
+        if (merge_cache_lock) {
+            apr_thread_rwlock_unlock(merge_cache_lock);
+        }
+#endif
+        if (apr_hash_count(merge_cache) >= (unsigned int)merge_cache_max) {
+            merge_cache_full = 1;
+        }
+        found = merged;
+    }
+#if APR_HAS_THREADS
+    if (merge_cache_mutex) {
+        apr_thread_mutex_unlock(merge_cache_mutex);
+    }
+#endif
+    if (found) {
+        *shared = 1;
+        return found;
+    }
+
+unshared:
+    /* cache full, merge per request as before */
+    *shared = 0;
+    return ap_merge_per_dir_configs(p, base, new_conf);
+}
+
 static ap_conf_vector_t *create_server_config(apr_pool_t *p, server_rec *s)
 {
     void **conf_vector = apr_pcalloc(p, sizeof(void *) * conf_vector_length);
@@ -393,6 +514,7 @@ AP_CORE_DECLARE(int) ap_invoke_handler(request_rec *r)
     int result;
     const char *old_handler = r->handler;
     const char *ignore;
+    core_request_config *req_cfg;
 
     /*
      * The new insert_filter stage makes the most sense here.  We only use
@@ -440,7 +562,16 @@ AP_CORE_DECLARE(int) ap_invoke_handler(request_rec *r)
         r->handler = handler;
     }
 
-    result = ap_run_handler(r);
+    req_cfg = ap_get_core_module_config(r->request_config);
+    if (req_cfg && req_cfg->phase_times) {
+        apr_time_t start = apr_time_now();
+        result = ap_run_handler(r);
+        req_cfg->phase_times[AP_REQUEST_PHASE_HANDLER] +=
+            apr_time_now() - start;
+    }
+    else {
+        result = ap_run_handler(r);
+    }
 
     r->handler = old_handler;
 
@@ -2292,10 +2423,84 @@ static int conf_vector_length_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
 }
 
 
+static apr_status_t merge_cache_cleanup(void *dummy)
+{
+    merge_cache_pool = NULL;
+    merge_cache = NULL;
+    merge_cache_full = 0;
+#if APR_HAS_THREADS
+    merge_cache_lock = NULL;
+    merge_cache_mutex = NULL;
+#endif
+    return APR_SUCCESS;
+}
+
+static int merge_cache_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
+                                  apr_pool_t *ptemp)
+{
+    merge_cache_max = AP_MERGE_CACHE_MAX;
+    return OK;
+}
+
+static int merge_cache_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+                                   apr_pool_t *ptemp, server_rec *s)
+{
+    apr_allocator_t *allocator;
+    apr_status_t rv;
+
+    if (merge_cache_max <= 0) {
+        return OK;
+    }
+
+    /* Merges happen in request threads, long after pconf has been
+     * handed to the MPM. Give the cache its own allocator and pool,
+     * only used under our mutex, and a lock for the hash. Without a
+     * cache, all merges are done per request.
+     */
+    rv = apr_allocator_create(&allocator);
+    if (rv == APR_SUCCESS) {
+        rv = apr_pool_create_ex(&merge_cache_pool, pconf, NULL, allocator);
+        if (rv != APR_SUCCESS) {
+            apr_allocator_destroy(allocator);
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(10488)
+                     "unable to create per-dir merge cache");
+        return OK;
+    }
+    apr_allocator_owner_set(allocator, merge_cache_pool);
+    apr_pool_tag(merge_cache_pool, "merge_cache");
+#if APR_HAS_THREADS
+    rv = apr_thread_mutex_create(&merge_cache_mutex, APR_THREAD_MUTEX_DEFAULT,
+                                 merge_cache_pool);
+    if (rv == APR_SUCCESS) {
+        rv = apr_thread_rwlock_create(&merge_cache_lock, merge_cache_pool);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(10489)
+                     "unable to create per-dir merge cache locks");
+        apr_pool_destroy(merge_cache_pool);
+        merge_cache_pool = NULL;
+        merge_cache_lock = NULL;
+        merge_cache_mutex = NULL;
+        return OK;
+    }
+#endif
+    merge_cache = apr_hash_make(merge_cache_pool);
+    apr_pool_cleanup_register(pconf, NULL, merge_cache_cleanup,
+                              apr_pool_cleanup_null);
+    return OK;
+}
+
 AP_CORE_DECLARE(void) ap_register_config_hooks(apr_pool_t *p)
 {
     ap_hook_pre_config(conf_vector_length_pre_config, NULL, NULL,
                        APR_HOOK_REALLY_LAST);
+    ap_hook_pre_config(merge_cache_pre_config, NULL, NULL,
+                       APR_HOOK_REALLY_LAST);
+    ap_hook_post_config(merge_cache_post_config, NULL, NULL,
+                        APR_HOOK_REALLY_LAST);
 }
 
 AP_DECLARE(server_rec*) ap_read_config(process_rec *process, apr_pool_t *ptemp,
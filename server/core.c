@@ -523,6 +523,7 @@ static void *create_core_server_config(apr_pool_t *a, server_rec *s)
     conf->async_filter = 0;
     conf->strict_host_check= AP_CORE_CONFIG_UNSET; 
     conf->merge_slashes    = AP_CORE_CONFIG_UNSET; 
+    conf->phase_timing     = AP_CORE_CONFIG_UNSET;
 
     return (void *)conf;
 }
@@ -624,6 +625,7 @@ static void *merge_core_server_configs(apr_pool_t *p, void *basev, void *virtv)
 
     AP_CORE_MERGE_FLAG(strict_host_check, conf, base, virt);
     AP_CORE_MERGE_FLAG(merge_slashes, conf, base, virt);
+    AP_CORE_MERGE_FLAG(phase_timing, conf, base, virt);
 
     return conf;
 }
@@ -3118,6 +3120,32 @@ static const char *set_regex_default_options(cmd_parms *cmd,
     return NULL;
 }
 
+static const char *set_dir_merge_cache(cmd_parms *cmd, void *dummy,
+                                       const char *arg)
+{
+    int entries;
+
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    if (strcasecmp(arg, "off") == 0) {
+        entries = 0;
+    }
+    else {
+        entries = atoi(arg);
+        if (entries <= 0) {
+            return apr_pstrcat(cmd->temp_pool, "DirMergeCache \"", arg,
+                               "\" must be 'off' or a positive integer",
+                               NULL);
+        }
+    }
+    ap_set_merge_cache_size(entries);
+
+    return NULL;
+}
+
 static const char *set_server_alias(cmd_parms *cmd, void *dummy,
                                     const char *arg)
 {
@@ -4888,6 +4916,8 @@ AP_INIT_TAKE12("RLimitNPROC", no_set_limit, NULL,
 
 AP_INIT_RAW_ARGS("RegexDefaultOptions", set_regex_default_options, NULL, RSRC_CONF,
                  "default options for regexes (prefixed by '+' to add, '-' to del)"),
+AP_INIT_TAKE1("DirMergeCache", set_dir_merge_cache, NULL, RSRC_CONF,
+              "'off' or the number of per-dir merges kept by each process"),
 
 /* internal recursion stopper */
 AP_INIT_TAKE12("LimitInternalRecursion", set_recursion_limit, NULL, RSRC_CONF,
@@ -4922,8 +4952,9 @@ AP_INIT_TAKE1("AllowEncodedSlashes", set_allow2f, NULL, RSRC_CONF,
 /* scoreboard.c directives */
 AP_INIT_TAKE1("ScoreBoardFile", ap_set_scoreboard, NULL, RSRC_CONF,
               "A file for Apache to maintain runtime process management information"),
-AP_INIT_FLAG("ExtendedStatus", ap_set_extended_status, NULL, RSRC_CONF,
-             "\"On\" to track extended status information, \"Off\" to disable"),
+AP_INIT_TAKE1("ExtendedStatus", ap_set_extended_status, NULL, RSRC_CONF,
+              "\"On\" to track extended status information, \"Lite\" to "
+              "track only the counters, \"Off\" to disable"),
 AP_INIT_FLAG("SeeRequestTail", ap_set_reqtail, NULL, RSRC_CONF,
              "For extended status, \"On\" to see the last 63 chars of "
              "the request line, \"Off\" (default) to see the first 63"),
@@ -4977,6 +5008,11 @@ AP_INIT_FLAG("MergeSlashes", set_core_server_flag,
              (void *)APR_OFFSETOF(core_server_config, merge_slashes),  
              RSRC_CONF,
              "Controls whether consecutive slashes in the URI path are merged"),
+AP_INIT_FLAG("RequestPhaseTiming", set_core_server_flag,
+             (void *)APR_OFFSETOF(core_server_config, phase_timing),
+             RSRC_CONF,
+             "Controls whether the time spent in each request processing "
+             "phase is measured"),
 { NULL }
 };
 
@@ -5331,6 +5367,9 @@ static int core_pre_config(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *ptem
     apr_pool_cleanup_register(pconf, NULL, reset_config, apr_pool_cleanup_null);
 
     ap_regcomp_set_default_cflags(AP_REG_DEFAULT);
+    ap_regcomp_jit_stats(NULL, NULL, 1);
+
+    ap_extended_status_lite = 0;
 
     mpm_common_pre_config(pconf);
 
@@ -5359,6 +5398,21 @@ static int core_post_config(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *pte
     }
     apr_pool_cleanup_register(pconf, NULL, ap_mpm_end_gen_helper,
                               apr_pool_cleanup_null);
+
+    if (APLOGinfo(s)) {
+        apr_uint32_t compiled, jitted;
+
+        if (ap_regcomp_jit_stats(&compiled, &jitted, 0)) {
+            ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(10457)
+                         "%u of %u regular expressions compiled by the "
+                         "PCRE JIT", jitted, compiled);
+        }
+        else {
+            ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(10458)
+                         "PCRE JIT not available, %u regular expressions "
+                         "will be interpreted", compiled);
+        }
+    }
     return OK;
 }
 
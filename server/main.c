@@ -409,6 +409,43 @@ static process_rec *init_process(int *argc, const char * const * *argv)
     return process;
 }
 
+/* Time spent in the phases of reading a configuration, reported by
+ * -t -D DUMP_CONFIG_TIMES and logged at level debug on (re)starts. */
+typedef struct {
+    apr_time_t start;
+    apr_time_t read;       /* ap_read_config() */
+    apr_time_t process;    /* pre_config, ap_process_config_tree(), vhost setup */
+    apr_time_t check;      /* check_config */
+    apr_time_t post;       /* open_logs, post_config */
+} config_times;
+
+#define CONF_MSEC(t, from) ((long)apr_time_as_msec((t) - (from)))
+
+static void dump_config_times(apr_pool_t *p, const config_times *ct)
+{
+    apr_file_t *out = NULL;
+
+    apr_file_open_stdout(&out, p);
+    apr_file_printf(out, "Config read: %ldms\n",
+                    CONF_MSEC(ct->read, ct->start));
+    apr_file_printf(out, "Config processed: %ldms\n",
+                    CONF_MSEC(ct->process, ct->read));
+    apr_file_printf(out, "Config checked: %ldms\n",
+                    CONF_MSEC(ct->check, ct->process));
+}
+
+static void log_config_times(const config_times *ct)
+{
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ap_server_conf, APLOGNO(10487)
+                 "configuration generation %d took %ldms: read %ldms, "
+                 "processed %ldms, checked %ldms, post_config %ldms",
+                 ap_config_generation, CONF_MSEC(ct->post, ct->start),
+                 CONF_MSEC(ct->read, ct->start),
+                 CONF_MSEC(ct->process, ct->read),
+                 CONF_MSEC(ct->check, ct->process),
+                 CONF_MSEC(ct->post, ct->check));
+}
+
 static void usage(process_rec *process)
 {
     const char *bin = process->argv[0];
@@ -511,6 +548,8 @@ static void usage(process_rec *process)
                  "  -M                 : a synonym for -t -D DUMP_MODULES");
     ap_log_error(APLOG_MARK, APLOG_STARTUP, 0, NULL,
                  "  -t -D DUMP_INCLUDES: show all included configuration files");
+    ap_log_error(APLOG_MARK, APLOG_STARTUP, 0, NULL,
+                 "  -t -D DUMP_CONFIG_TIMES: show time spent reading the configuration");
     ap_log_error(APLOG_MARK, APLOG_STARTUP, 0, NULL,
                  "  -t                 : run syntax check for config files");
     ap_log_error(APLOG_MARK, APLOG_STARTUP, 0, NULL,
@@ -544,6 +583,7 @@ static void usage(process_rec *process)
     const char *opt_arg;
     APR_OPTIONAL_FN_TYPE(ap_signal_server) *signal_server;
     int rc = OK;
+    config_times ctimes;
 
     AP_MONCONTROL(0); /* turn off profiling of startup */
 
@@ -718,6 +758,7 @@ static void usage(process_rec *process)
         ap_replace_stderr_log(process->pool, temp_error_log);
     }
     ap_server_conf = NULL; /* set early by ap_read_config() for logging */
+    ctimes.start = apr_time_now();
     if (!ap_read_config(process, ptemp, confname, &ap_conftree)) {
         if (showcompile) {
             /* Well, we tried. Show as much as we can, but exit nonzero to
@@ -727,6 +768,7 @@ static void usage(process_rec *process)
         }
         destroy_and_exit_process(process, 1);
     }
+    ctimes.read = apr_time_now();
     ap_assert(ap_server_conf != NULL);
     apr_pool_cleanup_register(pconf, &ap_server_conf, ap_pool_cleanup_set_null,
                               apr_pool_cleanup_null);
@@ -756,12 +798,14 @@ static void usage(process_rec *process)
          * perl.
          */
         apr_hook_sort_all();
+        ctimes.process = apr_time_now();
 
         if (ap_run_check_config(pconf, plog, ptemp, ap_server_conf) != OK) {
             ap_log_error(APLOG_MARK, APLOG_STARTUP |APLOG_ERR, 0,
                          NULL, APLOGNO(00014) "Configuration check failed");
             destroy_and_exit_process(process, 1);
         }
+        ctimes.check = apr_time_now();
 
         if (ap_run_mode != AP_SQ_RM_NORMAL) {
             if (showdirectives) { /* deferred in case of DSOs */
@@ -770,6 +814,8 @@ static void usage(process_rec *process)
             }
             else {
                 ap_run_test_config(pconf, ap_server_conf);
+                if (ap_exists_config_define("DUMP_CONFIG_TIMES"))
+                    dump_config_times(pconf, &ctimes);
                 if (ap_run_mode == AP_SQ_RM_CONFIG_TEST)
                     ap_log_error(APLOG_MARK, APLOG_STARTUP, 0, NULL, "Syntax OK");
             }
@@ -826,9 +872,11 @@ static void usage(process_rec *process)
         apr_pool_tag(ptemp, "ptemp");
         ap_server_root = def_server_root;
         ap_server_conf = NULL; /* set early by ap_read_config() for logging */
+        ctimes.start = apr_time_now();
         if (!ap_read_config(process, ptemp, confname, &ap_conftree)) {
             destroy_and_exit_process(process, 1);
         }
+        ctimes.read = apr_time_now();
         ap_assert(ap_server_conf != NULL);
         apr_pool_cleanup_register(pconf, &ap_server_conf,
                                   ap_pool_cleanup_set_null, apr_pool_cleanup_null);
@@ -853,12 +901,14 @@ static void usage(process_rec *process)
          * perl.
          */
         apr_hook_sort_all();
+        ctimes.process = apr_time_now();
 
         if (ap_run_check_config(pconf, plog, ptemp, ap_server_conf) != OK) {
             ap_log_error(APLOG_MARK, APLOG_EMERG, 0, NULL,
                          APLOGNO(00018) "Configuration check failed, exiting");
             destroy_and_exit_process(process, 1);
         }
+        ctimes.check = apr_time_now();
 
         apr_pool_clear(plog);
         if (ap_run_open_logs(pconf, plog, ptemp, ap_server_conf) != OK) {
@@ -872,6 +922,8 @@ static void usage(process_rec *process)
                          APLOGNO(00020) "Configuration Failed, exiting");
             destroy_and_exit_process(process, 1);
         }
+        ctimes.post = apr_time_now();
+        log_config_times(&ctimes);
 
         apr_pool_destroy(ptemp);
         apr_pool_lock(pconf, 1);
@@ -862,9 +862,12 @@ static apr_status_t decrement_connection_count(void *cs_)
 
 static void notify_suspend(event_conn_state_t *cs)
 {
-    ap_run_suspend_connection(cs->c, cs->r);
+    /* Suspended before the hooks run, which may hand the connection
+     * over to another thread (e.g. a poll callback resuming it).
+     */
     cs->c->sbh = NULL;
     cs->suspended = 1;
+    ap_run_suspend_connection(cs->c, cs->r);
 }
 
 static void notify_resume(event_conn_state_t *cs, int cleanup)
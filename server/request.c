@@ -107,6 +107,48 @@ AP_IMPLEMENT_HOOK_RUN_FIRST(int,force_authn,
 AP_IMPLEMENT_HOOK_RUN_FIRST(int,token_checker,
                             (request_rec *r), (r), DECLINED)
 
+static const char *const request_phase_names[AP_REQUEST_PHASE_MAX] = {
+    "translate", "storage", "headers", "auth", "type", "fixups", "handler"
+};
+
+AP_DECLARE(int) ap_request_phase_lookup(const char *name)
+{
+    int i;
+
+    for (i = 0; i < AP_REQUEST_PHASE_MAX; ++i) {
+        if (!ap_cstr_casecmp(name, request_phase_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+AP_DECLARE(apr_interval_time_t) ap_request_phase_time(const request_rec *r,
+                                                      int phase)
+{
+    core_request_config *req_cfg =
+        ap_get_core_module_config(r->request_config);
+
+    if (!req_cfg || !req_cfg->phase_times
+        || phase < 0 || phase >= AP_REQUEST_PHASE_MAX) {
+        return -1;
+    }
+    return req_cfg->phase_times[phase];
+}
+
+/* Account the time elapsed since *mark to the given phase and restart
+ * the clock, when RequestPhaseTiming is enabled (times != NULL).
+ */
+static APR_INLINE void phase_done(apr_interval_time_t *times, int phase,
+                                  apr_time_t *mark)
+{
+    if (times) {
+        apr_time_t now = apr_time_now();
+        times[phase] += now - *mark;
+        *mark = now;
+    }
+}
+
 static int auth_internal_per_conf = 0;
 static int auth_internal_per_conf_hooks = 0;
 static int auth_internal_per_conf_providers = 0;
@@ -195,8 +237,21 @@ AP_DECLARE(int) ap_process_request_internal(request_rec *r)
     int file_req = (r->main && r->filename);
     core_server_config *sconf =
         ap_get_core_module_config(r->server->module_config);
+    core_request_config *req_cfg =
+        ap_get_core_module_config(r->request_config);
+    apr_interval_time_t *times = NULL;
+    apr_time_t mark = 0;
     unsigned int normalize_flags;
 
+    if (sconf->phase_timing == AP_CORE_CONFIG_ON && req_cfg) {
+        if (!req_cfg->phase_times) {
+            req_cfg->phase_times = apr_pcalloc(r->pool, AP_REQUEST_PHASE_MAX
+                                               * sizeof(apr_interval_time_t));
+        }
+        times = req_cfg->phase_times;
+        mark = apr_time_now();
+    }
+
     normalize_flags = AP_NORMALIZE_NOT_ABOVE_ROOT;
     if (sconf->merge_slashes != AP_CORE_CONFIG_OFF) { 
         normalize_flags |= AP_NORMALIZE_MERGE_SLASHES;
@@ -284,6 +339,7 @@ AP_DECLARE(int) ap_process_request_internal(request_rec *r)
             return decl_die(access_status, "translate", r);
         }
     }
+    phase_done(times, AP_REQUEST_PHASE_TRANSLATE, &mark);
 
     /* Reset to the server default config prior to running map_to_storage
      */
@@ -303,12 +359,14 @@ AP_DECLARE(int) ap_process_request_internal(request_rec *r)
     if ((access_status = ap_run_post_perdir_config(r))) {
         return access_status;
     }
+    phase_done(times, AP_REQUEST_PHASE_STORAGE, &mark);
 
     /* Only on the main request! */
     if (r->main == NULL) {
         if ((access_status = ap_run_header_parser(r))) {
             return access_status;
         }
+        phase_done(times, AP_REQUEST_PHASE_HEADERS, &mark);
     }
 
     /* Skip authn/authz if the parent or prior request passed the authn/authz,
@@ -428,15 +486,18 @@ AP_DECLARE(int) ap_process_request_internal(request_rec *r)
      * in mod-proxy for r->proxyreq && r->parsed_uri.scheme
      *                              && !strcmp(r->parsed_uri.scheme, "http")
      */
+    phase_done(times, AP_REQUEST_PHASE_AUTH, &mark);
     if ((access_status = ap_run_type_checker(r)) != OK) {
         return decl_die(access_status, "find types", r);
     }
+    phase_done(times, AP_REQUEST_PHASE_TYPE, &mark);
 
     if ((access_status = ap_run_fixups(r)) != OK) {
         ap_log_rerror(APLOG_MARK, APLOG_TRACE3, 0, r, "fixups hook gave %d: %s",
                       access_status, r->uri);
         return access_status;
     }
+    phase_done(times, AP_REQUEST_PHASE_FIXUPS, &mark);
 
     return OK;
 }
@@ -455,6 +516,7 @@ AP_DECLARE(int) ap_process_request_internal(request_rec *r)
 typedef struct walk_walked_t {
     ap_conf_vector_t *matched; /* A dir_conf sections we matched */
     ap_conf_vector_t *merged;  /* The dir_conf merged result */
+    int shared;                /* merged is shared by all requests */
 } walk_walked_t;
 
 typedef struct walk_cache_t {
@@ -467,6 +529,21 @@ typedef struct walk_cache_t {
     int count; /* Number of prev invocations of same call in this (sub)req */
 } walk_cache_t;
 
+/* Merge a matched section onto the sections walked so far.  While both
+ * live as long as the configuration, i.e. no .htaccess was merged, the
+ * result is shared by all requests of the process and *shared stays set.
+ * Only the <Directory > and <Location > walks use this, since <Files >
+ * and <If > sections may come from a request's .htaccess.
+ */
+static ap_conf_vector_t *merge_walked(request_rec *r, ap_conf_vector_t *base,
+                                      ap_conf_vector_t *sec, int *shared)
+{
+    if (*shared) {
+        return ap_merge_per_dir_configs_shared(r->pool, base, sec, shared);
+    }
+    return ap_merge_per_dir_configs(r->pool, base, sec);
+}
+
 static walk_cache_t *prep_walk_cache(apr_size_t t, request_rec *r)
 {
     void **note, **inherit_note;
@@ -680,6 +757,7 @@ static void core_opts_merge(const ap_conf_vector_t *sec, core_opts_t *opts)
 AP_DECLARE(int) ap_directory_walk(request_rec *r)
 {
     ap_conf_vector_t *now_merged = NULL;
+    int now_shared = 1;
     core_server_config *sconf =
         ap_get_core_module_config(r->server->module_config);
     ap_conf_vector_t **sec_ent = (ap_conf_vector_t **) sconf->sec_dir->elts;
@@ -845,6 +923,8 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
         if (cache->walked->nelts) {
             now_merged = ((walk_walked_t*)cache->walked->elts)
                 [cache->walked->nelts - 1].merged;
+            now_shared = ((walk_walked_t*)cache->walked->elts)
+                [cache->walked->nelts - 1].shared;
         }
     }
     else {
@@ -1056,6 +1136,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 if (matches) {
                     if (last_walk->matched == sec_ent[sec_idx]) {
                         now_merged = last_walk->merged;
+                        now_shared = last_walk->shared;
                         ++last_walk;
                         --matches;
                         continue;
@@ -1070,9 +1151,8 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 }
 
                 if (now_merged) {
-                    now_merged = ap_merge_per_dir_configs(r->pool,
-                                                          now_merged,
-                                                          sec_ent[sec_idx]);
+                    now_merged = merge_walked(r, now_merged, sec_ent[sec_idx],
+                                              &now_shared);
                 }
                 else {
                     now_merged = sec_ent[sec_idx];
@@ -1081,6 +1161,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 last_walk = (walk_walked_t*)apr_array_push(cache->walked);
                 last_walk->matched = sec_ent[sec_idx];
                 last_walk->merged = now_merged;
+                last_walk->shared = now_shared;
             }
 
             /* If .htaccess files are enabled, check for one, provided we
@@ -1125,6 +1206,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 if (matches) {
                     if (last_walk->matched == htaccess_conf) {
                         now_merged = last_walk->merged;
+                        now_shared = last_walk->shared;
                         ++last_walk;
                         --matches;
                         break;
@@ -1147,10 +1229,13 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 else {
                     now_merged = htaccess_conf;
                 }
+                /* .htaccess lives only as long as the request */
+                now_shared = 0;
 
                 last_walk = (walk_walked_t*)apr_array_push(cache->walked);
                 last_walk->matched = htaccess_conf;
                 last_walk->merged = now_merged;
+                last_walk->shared = now_shared;
 
             } while (0); /* Only one htaccess, not a real loop */
 
@@ -1365,6 +1450,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
             if (matches) {
                 if (last_walk->matched == sec_ent[sec_idx]) {
                     now_merged = last_walk->merged;
+                    now_shared = last_walk->shared;
                     ++last_walk;
                     --matches;
                     continue;
@@ -1379,9 +1465,8 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = merge_walked(r, now_merged, sec_ent[sec_idx],
+                                          &now_shared);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1390,6 +1475,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
             last_walk = (walk_walked_t*)apr_array_push(cache->walked);
             last_walk->matched = sec_ent[sec_idx];
             last_walk->merged = now_merged;
+            last_walk->shared = now_shared;
         }
 
         if (rxpool) {
@@ -1471,6 +1557,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
 AP_DECLARE(int) ap_location_walk(request_rec *r)
 {
     ap_conf_vector_t *now_merged = NULL;
+    int now_shared = 1;
     core_server_config *sconf =
         ap_get_core_module_config(r->server->module_config);
     ap_conf_vector_t **sec_ent = (ap_conf_vector_t **)sconf->sec_url->elts;
@@ -1523,6 +1610,8 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
         if (cache->walked->nelts) {
             now_merged = ((walk_walked_t*)cache->walked->elts)
                                             [cache->walked->nelts - 1].merged;
+            now_shared = ((walk_walked_t*)cache->walked->elts)
+                                            [cache->walked->nelts - 1].shared;
         }
     }
     else {
@@ -1605,6 +1694,7 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
             if (matches) {
                 if (last_walk->matched == sec_ent[sec_idx]) {
                     now_merged = last_walk->merged;
+                    now_shared = last_walk->shared;
                     ++last_walk;
                     --matches;
                     continue;
@@ -1619,9 +1709,8 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = merge_walked(r, now_merged, sec_ent[sec_idx],
+                                          &now_shared);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1630,6 +1719,7 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
             last_walk = (walk_walked_t*)apr_array_push(cache->walked);
             last_walk->matched = sec_ent[sec_idx];
             last_walk->merged = now_merged;
+            last_walk->shared = now_shared;
         }
 
         if (rxpool) {
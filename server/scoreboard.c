@@ -60,13 +60,36 @@ const char * ap_set_scoreboard(cmd_parms *cmd, void *dummy,
 /* Default to false when mod_status is not loaded */
 AP_DECLARE_DATA int ap_extended_status = 0;
 
-const char *ap_set_extended_status(cmd_parms *cmd, void *dummy, int arg)
+/* With ExtendedStatus Lite, only the numeric fields of the workers are
+ * maintained: no request/client/vhost strings are copied and the CPU
+ * times are sampled every SB_TIMES_INTERVAL requests.
+ */
+AP_DECLARE_DATA int ap_extended_status_lite = 0;
+
+#define SB_TIMES_INTERVAL 16
+
+const char *ap_set_extended_status(cmd_parms *cmd, void *dummy,
+                                   const char *arg)
 {
     const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
     if (err != NULL) {
         return err;
     }
-    ap_extended_status = arg;
+    if (!ap_cstr_casecmp(arg, "On")) {
+        ap_extended_status = 1;
+        ap_extended_status_lite = 0;
+    }
+    else if (!ap_cstr_casecmp(arg, "Lite")) {
+        ap_extended_status = 1;
+        ap_extended_status_lite = 1;
+    }
+    else if (!ap_cstr_casecmp(arg, "Off")) {
+        ap_extended_status = 0;
+        ap_extended_status_lite = 0;
+    }
+    else {
+        return "ExtendedStatus must be On, Off or Lite";
+    }
     return NULL;
 }
 
@@ -130,19 +153,34 @@ static apr_status_t ap_cleanup_shared_mem(void *d)
     return APR_SUCCESS;
 }
 
+/* The shared sections written by different processes (the global and
+ * process scores by the parent, each child's worker scores by the child
+ * itself) start on their own cache line to avoid false sharing. The
+ * usable address of the segment need not be line aligned (APR puts its
+ * own header first), so one more line is reserved for aligning the start.
+ */
+#define SB_CACHE_LINE         64
+#define SB_ALIGN_LINE(size)   APR_ALIGN((size), SB_CACHE_LINE)
+
 #define SIZE_OF_scoreboard    APR_ALIGN_DEFAULT(sizeof(scoreboard))
-#define SIZE_OF_global_score  APR_ALIGN_DEFAULT(sizeof(global_score))
+#define SIZE_OF_global_score  SB_ALIGN_LINE(sizeof(global_score))
 #define SIZE_OF_process_score APR_ALIGN_DEFAULT(sizeof(process_score))
 #define SIZE_OF_worker_score  APR_ALIGN_DEFAULT(sizeof(worker_score))
 
+#define SIZE_OF_process_scores \
+    SB_ALIGN_LINE(SIZE_OF_process_score * server_limit)
+#define SIZE_OF_child_workers \
+    SB_ALIGN_LINE(SIZE_OF_worker_score * thread_limit)
+
 AP_DECLARE(int) ap_calc_scoreboard_size(void)
 {
     ap_mpm_query(AP_MPMQ_HARD_LIMIT_THREADS, &thread_limit);
     ap_mpm_query(AP_MPMQ_HARD_LIMIT_DAEMONS, &server_limit);
 
-    scoreboard_size  = SIZE_OF_global_score;
-    scoreboard_size += SIZE_OF_process_score * server_limit;
-    scoreboard_size += SIZE_OF_worker_score * server_limit * thread_limit;
+    scoreboard_size  = SB_CACHE_LINE;
+    scoreboard_size += SIZE_OF_global_score;
+    scoreboard_size += SIZE_OF_process_scores;
+    scoreboard_size += SIZE_OF_child_workers * server_limit;
 
     return scoreboard_size;
 }
@@ -160,18 +198,18 @@ AP_DECLARE(void) ap_init_scoreboard(void *shared_score)
     ap_calc_scoreboard_size();
     ap_scoreboard_image =
         ap_calloc(1, SIZE_OF_scoreboard + server_limit * sizeof(worker_score *));
-    more_storage = shared_score;
+    more_storage = (char *)SB_ALIGN_LINE((apr_uintptr_t)shared_score);
     ap_scoreboard_image->global = (global_score *)more_storage;
     more_storage += SIZE_OF_global_score;
     ap_scoreboard_image->parent = (process_score *)more_storage;
-    more_storage += SIZE_OF_process_score * server_limit;
+    more_storage += SIZE_OF_process_scores;
     ap_scoreboard_image->servers =
         (worker_score **)((char*)ap_scoreboard_image + SIZE_OF_scoreboard);
     for (i = 0; i < server_limit; i++) {
         ap_scoreboard_image->servers[i] = (worker_score *)more_storage;
-        more_storage += thread_limit * SIZE_OF_worker_score;
+        more_storage += SIZE_OF_child_workers;
     }
-    ap_assert(more_storage == (char*)shared_score + scoreboard_size);
+    ap_assert(more_storage <= (char*)shared_score + scoreboard_size);
     ap_scoreboard_image->global->server_limit = server_limit;
     ap_scoreboard_image->global->thread_limit = thread_limit;
 }
@@ -389,7 +427,10 @@ AP_DECLARE(void) ap_increment_counts(ap_sb_handle_t *sb, request_rec *r)
     }
 
 #ifdef HAVE_TIMES
-    times(&ws->times);
+    if (!ap_extended_status_lite
+        || ws->my_access_count % SB_TIMES_INTERVAL == 0) {
+        times(&ws->times);
+    }
 #endif
     ws->access_count++;
     ws->my_access_count++;
@@ -519,6 +560,10 @@ static int update_child_status_internal(int child_num,
             ws->last_used = apr_time_now();
         }
 
+        if (ap_extended_status_lite) {
+            return old_status;
+        }
+
         if (descr) {
             apr_cpystrn(ws->request, descr, sizeof(ws->request));
         }
@@ -2332,6 +2332,145 @@ AP_DECLARE(apr_size_t) ap_escape_errorlog_item(char *dest, const char *source,
     return (d - (unsigned char *)dest);
 }
 
+/* Decode one UTF-8 encoded code point, rejecting overlong forms,
+ * surrogates and values beyond U+10FFFF. Returns the number of bytes
+ * consumed, or 0 if the sequence is invalid.
+ */
+static int utf8_decode(const unsigned char *s, apr_uint32_t *pcp)
+{
+    if (s[0] < 0xc2) {
+        return 0;
+    }
+    if (s[0] < 0xe0) {
+        if ((s[1] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *pcp = ((s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+        return 2;
+    }
+    if (s[0] < 0xf0) {
+        if ((s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *pcp = ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+        if (*pcp < 0x800 || (*pcp >= 0xd800 && *pcp <= 0xdfff)) {
+            return 0;
+        }
+        return 3;
+    }
+    if (s[0] < 0xf5) {
+        if ((s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80
+            || (s[3] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *pcp = ((apr_uint32_t)(s[0] & 0x07) << 18) | ((s[1] & 0x3f) << 12)
+               | ((s[2] & 0x3f) << 6) | (s[3] & 0x3f);
+        if (*pcp < 0x10000 || *pcp > 0x10ffff) {
+            return 0;
+        }
+        return 4;
+    }
+    return 0;
+}
+
+static APR_INLINE unsigned char *json_u_escape(apr_uint32_t cp,
+                                               unsigned char *d)
+{
+    *d++ = '\\';
+    *d++ = 'u';
+    *d++ = c2x_table[(cp >> 12) & 0xf];
+    *d++ = c2x_table[(cp >> 8) & 0xf];
+    *d++ = c2x_table[(cp >> 4) & 0xf];
+    *d++ = c2x_table[cp & 0xf];
+    return d;
+}
+
+AP_DECLARE(apr_size_t) ap_escape_json(char *dest, const char *source)
+{
+    const unsigned char *s = (const unsigned char *)source;
+    unsigned char *d = (unsigned char *)dest;
+    apr_size_t len = 0;
+    apr_uint32_t cp;
+    int n;
+
+    if (!s) {
+        if (d) {
+            *d = '\0';
+        }
+        return 0;
+    }
+
+    for (; *s; ++s) {
+        if (*s >= 0x20 && *s < 0x80 && *s != '"' && *s != '\\') {
+            if (d) {
+                *d++ = *s;
+            }
+            ++len;
+            continue;
+        }
+        switch (*s) {
+        case '"':
+        case '\\':
+            cp = *s;
+            break;
+        case '\b':
+            cp = 'b';
+            break;
+        case '\f':
+            cp = 'f';
+            break;
+        case '\n':
+            cp = 'n';
+            break;
+        case '\r':
+            cp = 'r';
+            break;
+        case '\t':
+            cp = 't';
+            break;
+        default:
+            cp = 0;
+        }
+        if (cp) {
+            if (d) {
+                *d++ = '\\';
+                *d++ = (unsigned char)cp;
+            }
+            len += 2;
+        }
+        else if (*s < 0x80 || !(n = utf8_decode(s, &cp))) {
+            /* control character, or a byte that is not valid UTF-8,
+             * which we take for ISO-8859-1 */
+            if (d) {
+                d = json_u_escape(*s, d);
+            }
+            len += 6;
+        }
+        else if (cp < 0x10000) {
+            if (d) {
+                d = json_u_escape(cp, d);
+            }
+            len += 6;
+            s += n - 1;
+        }
+        else {
+            /* UTF-16 surrogate pair */
+            cp -= 0x10000;
+            if (d) {
+                d = json_u_escape(0xd800 | (cp >> 10), d);
+                d = json_u_escape(0xdc00 | (cp & 0x3ff), d);
+            }
+            len += 12;
+            s += n - 1;
+        }
+    }
+    if (d) {
+        *d = '\0';
+    }
+
+    return len;
+}
+
 AP_DECLARE(void) ap_bin2hex(const void *src, apr_size_t srclen, char *dest)
 {
     const unsigned char *in = src;
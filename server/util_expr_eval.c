@@ -80,6 +80,8 @@ static const char *ap_expr_regexec(const char *subject,
 static apr_array_header_t *ap_expr_list_make(ap_expr_eval_ctx_t *ctx,
                                              const ap_expr_t *node);
 
+static ap_expr_t *expr_fold(ap_expr_t *node, ap_expr_parse_ctx_t *ctx);
+
 /* define AP_EXPR_DEBUG to log the parse tree when parsing an expression */
 #ifdef AP_EXPR_DEBUG
 static void expr_dump_tree(const ap_expr_t *e, const server_rec *s,
@@ -446,35 +448,63 @@ static apr_array_header_t *ap_expr_list_make(ap_expr_eval_ctx_t *ctx,
     return list;
 }
 
+/* Compare two words with one of the binary comparison operators
+ * op_EQ ... op_STR_GE, returns -1 for any other operator.
+ */
+static int ap_expr_comp_words(ap_expr_node_op_e op, const char *s1,
+                              const char *s2)
+{
+    switch (op) {
+    case op_EQ:
+        return (intstrcmp(s1, s2) == 0);
+    case op_NE:
+        return (intstrcmp(s1, s2) != 0);
+    case op_LT:
+        return (intstrcmp(s1, s2) <  0);
+    case op_LE:
+        return (intstrcmp(s1, s2) <= 0);
+    case op_GT:
+        return (intstrcmp(s1, s2) >  0);
+    case op_GE:
+        return (intstrcmp(s1, s2) >= 0);
+    case op_STR_EQ:
+        return (strcmp(s1, s2) == 0);
+    case op_STR_NE:
+        return (strcmp(s1, s2) != 0);
+    case op_STR_LT:
+        return (strcmp(s1, s2) <  0);
+    case op_STR_LE:
+        return (strcmp(s1, s2) <= 0);
+    case op_STR_GT:
+        return (strcmp(s1, s2) >  0);
+    case op_STR_GE:
+        return (strcmp(s1, s2) >= 0);
+    default:
+        return -1;
+    }
+}
+
 static int ap_expr_eval_comp(ap_expr_eval_ctx_t *ctx, const ap_expr_t *node)
 {
     const ap_expr_t *e1 = node->node_arg1;
     const ap_expr_t *e2 = node->node_arg2;
     switch (node->node_op) {
     case op_EQ:
-        return (intstrcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) == 0);
     case op_NE:
-        return (intstrcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) != 0);
     case op_LT:
-        return (intstrcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) <  0);
     case op_LE:
-        return (intstrcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) <= 0);
     case op_GT:
-        return (intstrcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) >  0);
     case op_GE:
-        return (intstrcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) >= 0);
     case op_STR_EQ:
-        return (strcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) == 0);
     case op_STR_NE:
-        return (strcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) != 0);
     case op_STR_LT:
-        return (strcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) <  0);
     case op_STR_LE:
-        return (strcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) <= 0);
     case op_STR_GT:
-        return (strcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) >  0);
-    case op_STR_GE:
-        return (strcmp(ap_expr_eval_word(ctx, e1), ap_expr_eval_word(ctx, e2)) >= 0);
+    case op_STR_GE: {
+            const char *s1 = ap_expr_eval_word(ctx, e1);
+            const char *s2 = ap_expr_eval_word(ctx, e2);
+            return ap_expr_comp_words(node->node_op, s1, s2);
+        }
     case op_IN: {
             int n;
             const char *needle, *subject;
@@ -617,6 +647,9 @@ AP_DECLARE(const char *) ap_expr_parse(apr_pool_t *pool, apr_pool_t *ptemp,
     if (rc) /* XXX can this happen? */
         return "syntax error";
 
+    if (ctx.expr && !(ctx.flags & AP_EXPR_FLAG_NO_FOLD))
+        ctx.expr = expr_fold(ctx.expr, &ctx);
+
 #ifdef AP_EXPR_DEBUG
     if (ctx.expr)
         expr_dump_tree(ctx.expr, NULL, APLOG_NOTICE, 2);
@@ -820,6 +853,123 @@ ap_expr_t *ap_expr_backref_make(int num, ap_expr_parse_ctx_t *ctx)
     return ap_expr_make(op_Backref, n, NULL, ctx);
 }
 
+#define EXPR_IS_CONST_WORD(e) ((e)->node_op == op_String \
+                               || (e)->node_op == op_Digit)
+#define EXPR_IS_CONST_COND(e) ((e)->node_op == op_True \
+                               || (e)->node_op == op_False)
+
+/*
+ * Evaluate at parse time what does not depend on the request: literal
+ * concatenations, comparisons of literals, and the logical operators
+ * whose result is decided by a constant operand. Operands which would
+ * be evaluated at runtime anyway (for their side effects on Vary or
+ * regex backrefs) are never dropped.
+ */
+static ap_expr_t *expr_fold(ap_expr_t *node, ap_expr_parse_ctx_t *ctx)
+{
+    ap_expr_t *e1, *e2;
+
+    switch (node->node_op) {
+    case op_Not:
+        e1 = expr_fold((ap_expr_t *)node->node_arg1, ctx);
+        if (EXPR_IS_CONST_COND(e1)) {
+            return ap_expr_make(e1->node_op == op_True ? op_False : op_True,
+                                NULL, NULL, ctx);
+        }
+        node->node_arg1 = e1;
+        break;
+    case op_And:
+    case op_Or: {
+        ap_expr_node_op_e absorbing = node->node_op == op_And ? op_False
+                                                               : op_True;
+        e1 = expr_fold((ap_expr_t *)node->node_arg1, ctx);
+        e2 = expr_fold((ap_expr_t *)node->node_arg2, ctx);
+        if (EXPR_IS_CONST_COND(e1)) {
+            /* the right operand is only ever evaluated for the neutral */
+            return e1->node_op == absorbing ? e1 : e2;
+        }
+        if (EXPR_IS_CONST_COND(e2) && e2->node_op != absorbing) {
+            return e1;
+        }
+        node->node_arg1 = e1;
+        node->node_arg2 = e2;
+        break;
+    }
+    case op_Comp:
+        e1 = (ap_expr_t *)node->node_arg1;
+        switch (e1->node_op) {
+        case op_IN:
+        case op_REG:
+        case op_NRE:
+            e1->node_arg1 = expr_fold((ap_expr_t *)e1->node_arg1, ctx);
+            break;
+        case op_EQ:
+        case op_NE:
+        case op_LT:
+        case op_LE:
+        case op_GT:
+        case op_GE:
+        case op_STR_EQ:
+        case op_STR_NE:
+        case op_STR_LT:
+        case op_STR_LE:
+        case op_STR_GT:
+        case op_STR_GE:
+            e1->node_arg1 = expr_fold((ap_expr_t *)e1->node_arg1, ctx);
+            e1->node_arg2 = expr_fold((ap_expr_t *)e1->node_arg2, ctx);
+            if (!(ctx->flags & AP_EXPR_FLAG_SSL_EXPR_COMPAT)
+                && EXPR_IS_CONST_WORD((ap_expr_t *)e1->node_arg1)
+                && EXPR_IS_CONST_WORD((ap_expr_t *)e1->node_arg2)) {
+                const ap_expr_t *w1 = e1->node_arg1, *w2 = e1->node_arg2;
+                int rc = ap_expr_comp_words(e1->node_op, w1->node_arg1,
+                                            w2->node_arg1);
+                return ap_expr_make(rc ? op_True : op_False, NULL, NULL, ctx);
+            }
+            break;
+        default:
+            break;
+        }
+        break;
+    case op_Word:
+    case op_Bool:
+    case op_Sub:
+        node->node_arg1 = expr_fold((ap_expr_t *)node->node_arg1, ctx);
+        break;
+    case op_Concat:
+        e1 = expr_fold((ap_expr_t *)node->node_arg1, ctx);
+        e2 = expr_fold((ap_expr_t *)node->node_arg2, ctx);
+        if (EXPR_IS_CONST_WORD(e2)) {
+            if (EXPR_IS_CONST_WORD(e1)) {
+                return ap_expr_make(op_String,
+                                    apr_pstrcat(ctx->pool, e1->node_arg1,
+                                                e2->node_arg1, NULL),
+                                    NULL, ctx);
+            }
+            if (e1->node_op == op_Concat
+                && EXPR_IS_CONST_WORD((ap_expr_t *)e1->node_arg2)) {
+                /* (x . "a") . "b" => x . "ab" */
+                const ap_expr_t *w = e1->node_arg2;
+                e2 = ap_expr_make(op_String,
+                                  apr_pstrcat(ctx->pool, w->node_arg1,
+                                              e2->node_arg1, NULL),
+                                  NULL, ctx);
+                e1 = (ap_expr_t *)e1->node_arg1;
+            }
+        }
+        return ap_expr_concat_make(e1, e2, ctx);
+    case op_StringFuncCall:
+        e2 = (ap_expr_t *)node->node_arg2;
+        if (e2->node_op != op_ListElement) {
+            node->node_arg2 = expr_fold(e2, ctx);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return node;
+}
+
 #ifdef AP_EXPR_DEBUG
 
 #define MARK                        APLOG_MARK,loglevel,0,s
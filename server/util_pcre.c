@@ -53,6 +53,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "httpd.h"
+#include "apr_atomic.h"
 #include "apr_strings.h"
 #include "apr_tables.h"
 
@@ -88,6 +89,16 @@ POSSIBILITY OF SUCH DAMAGE.
     APR_ALIGN_DEFAULT(POSIX_MALLOC_THRESHOLD * sizeof(int) * 3)
 #endif
 
+/* Bounds of the per-thread stack used by JIT compiled patterns, PCRE2
+ * otherwise uses 32K of the machine stack which deep patterns exhaust.
+ */
+#ifndef AP_PCRE_JIT_STACK_MIN
+#define AP_PCRE_JIT_STACK_MIN (32 * 1024)
+#endif
+#ifndef AP_PCRE_JIT_STACK_MAX
+#define AP_PCRE_JIT_STACK_MAX (512 * 1024)
+#endif
+
 /* Table of error strings corresponding to POSIX error codes; must be
  * kept in synch with include/ap_regex.h's AP_REG_E* definitions.
  */
@@ -170,6 +181,9 @@ AP_DECLARE(void) ap_regfree(ap_regex_t *preg)
 
 static int default_cflags = AP_REG_DEFAULT;
 
+static apr_uint32_t regcomp_compiled;
+static apr_uint32_t regcomp_jitted;
+
 AP_DECLARE(int) ap_regcomp_get_default_cflags(void)
 {
     return default_cflags;
@@ -196,10 +210,43 @@ AP_DECLARE(int) ap_regcomp_default_cflag_by_name(const char *name)
     else if (ap_cstr_casecmp(name, "EXTENDED") == 0) {
         cflag = AP_REG_EXTENDED;
     }
+    else if (ap_cstr_casecmp(name, "NO_JIT") == 0) {
+        cflag = AP_REG_NO_JIT;
+    }
 
     return cflag;
 }
 
+static int jit_available(void)
+{
+#ifdef HAVE_PCRE2
+    uint32_t jit = 0;
+
+    if (pcre2_config(PCRE2_CONFIG_JIT, &jit) < 0) {
+        return 0;
+    }
+    return jit != 0;
+#else
+    return 0;
+#endif
+}
+
+AP_DECLARE(int) ap_regcomp_jit_stats(apr_uint32_t *compiled,
+                                     apr_uint32_t *jitted, int reset)
+{
+    if (compiled) {
+        *compiled = apr_atomic_read32(&regcomp_compiled);
+    }
+    if (jitted) {
+        *jitted = apr_atomic_read32(&regcomp_jitted);
+    }
+    if (reset) {
+        apr_atomic_set32(&regcomp_compiled, 0);
+        apr_atomic_set32(&regcomp_jitted, 0);
+    }
+    return jit_available();
+}
+
 /*
  * Arguments:
  *  preg        points to a structure for recording the compiled expression
@@ -254,7 +301,19 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
     pcre2_pattern_info((const pcre2_code *)preg->re_pcre,
                        PCRE2_INFO_CAPTURECOUNT, &capcount);
     preg->re_nsub = capcount;
+
+    /* Failing to JIT compile is not an error, pcre2_match() will simply
+     * keep interpreting the pattern.
+     */
+    apr_atomic_inc32(&regcomp_compiled);
+    if ((cflags & AP_REG_NO_JIT) == 0
+            && jit_available()
+            && pcre2_jit_compile((pcre2_code *)preg->re_pcre,
+                                 PCRE2_JIT_COMPLETE) == 0) {
+        apr_atomic_inc32(&regcomp_jitted);
+    }
 #else
+    apr_atomic_inc32(&regcomp_compiled);
     pcre_fullinfo((const pcre *)preg->re_pcre, NULL,
                   PCRE_INFO_CAPTURECOUNT, &(preg->re_nsub));
 #endif
@@ -295,6 +354,9 @@ typedef int*        match_vector_pt;
 
 #if APREG_USE_THREAD_LOCAL
 static AP_THREAD_LOCAL apr_pool_t *thread_pool;
+#ifdef HAVE_PCRE2
+static AP_THREAD_LOCAL pcre2_match_context *thread_jit_mctx;
+#endif
 #endif
 
 struct match_data_state {
@@ -423,6 +485,68 @@ void cleanup_state(struct match_data_state *state)
 #endif
 }
 
+#ifdef HAVE_PCRE2
+static APR_INLINE int is_jitted(const pcre2_code *re)
+{
+    size_t jitsize = 0;
+
+    return pcre2_pattern_info(re, PCRE2_INFO_JITSIZE, &jitsize) == 0
+           && jitsize > 0;
+}
+
+#if APREG_USE_THREAD_LOCAL
+static apr_status_t jit_stack_cleanup(void *stack)
+{
+    pcre2_jit_stack_free(stack);
+    return APR_SUCCESS;
+}
+
+static apr_status_t jit_mctx_cleanup(void *mctx)
+{
+    pcre2_match_context_free(mctx);
+    return APR_SUCCESS;
+}
+
+/* The match context holding this thread's JIT stack, created on first
+ * use and living as long as the thread's pool.
+ */
+static pcre2_match_context *get_jit_mctx(struct match_data_state *state)
+{
+    pcre2_match_context *mctx = thread_jit_mctx;
+    pcre2_jit_stack *stack;
+    apr_pool_t *tp;
+
+    if (mctx || !state->thd) {
+        return mctx;
+    }
+
+    stack = pcre2_jit_stack_create(AP_PCRE_JIT_STACK_MIN,
+                                   AP_PCRE_JIT_STACK_MAX, NULL);
+    if (!stack) {
+        return NULL;
+    }
+    mctx = pcre2_match_context_create(NULL);
+    if (!mctx) {
+        pcre2_jit_stack_free(stack);
+        return NULL;
+    }
+    pcre2_jit_stack_assign(mctx, NULL, stack);
+
+    /* cleanups run in reverse order, the context goes before its stack */
+    tp = apr_thread_pool_get(state->thd);
+    apr_pool_cleanup_register(tp, stack, jit_stack_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_cleanup_register(tp, mctx, jit_mctx_cleanup,
+                              apr_pool_cleanup_null);
+    thread_jit_mctx = mctx;
+
+    return mctx;
+}
+#else
+#define get_jit_mctx(state) NULL
+#endif
+#endif /* HAVE_PCRE2 */
+
 AP_DECLARE(int) ap_regexec(const ap_regex_t *preg, const char *string,
                            apr_size_t nmatch, ap_regmatch_t *pmatch,
                            int eflags)
@@ -481,9 +605,21 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
         options |= PCREn(ANCHORED);
 
 #ifdef HAVE_PCRE2
-    rc = pcre2_match((const pcre2_code *)preg->re_pcre,
-                     (const unsigned char *)buff, len, 0, options,
-                     state.match_data, NULL);
+    /* The JIT does not support PCRE2_ANCHORED at match time, and may run
+     * out of stack, let pcre2_match() interpret the pattern in both cases.
+     */
+    rc = PCRE2_ERROR_JIT_STACKLIMIT;
+    if ((options & PCRE2_ANCHORED) == 0
+            && is_jitted((const pcre2_code *)preg->re_pcre)) {
+        rc = pcre2_jit_match((const pcre2_code *)preg->re_pcre,
+                             (const unsigned char *)buff, len, 0, options,
+                             state.match_data, get_jit_mctx(&state));
+    }
+    if (rc == PCRE2_ERROR_JIT_STACKLIMIT) {
+        rc = pcre2_match((const pcre2_code *)preg->re_pcre,
+                         (const unsigned char *)buff, len, 0,
+                         options | PCRE2_NO_JIT, state.match_data, NULL);
+    }
     ovector = pcre2_get_ovector_pointer(state.match_data);
 #else
     ovector = state.match_data;
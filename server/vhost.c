@@ -23,6 +23,7 @@
 #include "apr.h"
 #include "apr_strings.h"
 #include "apr_lib.h"
+#include "apr_hash.h"
 #include "apr_version.h"
 
 #define APR_WANT_STRFUNC
@@ -54,11 +55,26 @@
  * lists of name-vhosts.
  */
 typedef struct name_chain name_chain;
+typedef struct name_index name_index;
 struct name_chain {
     name_chain *next;
     server_addr_rec *sar;       /* the record causing it to be in
                                  * this chain (needed for port comparisons) */
     server_rec *server;         /* the server to use on a match */
+    int pos;                    /* position in the chain */
+    name_index *index;          /* names of the chain (on its head only) */
+};
+
+/* The names of the vhosts of a name_chain, for ap_vhost_find_given_conn().
+ * The (lowercase) ServerName/ServerAlias names and the domains of the
+ * "*.domain" aliases are hashed to the arrays of the name_chain entries
+ * having them, in chain order. The vhosts with other wildcard aliases
+ * are checked one by one.
+ */
+struct name_index {
+    apr_hash_t *exact;
+    apr_hash_t *domains;
+    apr_array_header_t *others;
 };
 
 /* meta-list of ip addresses.  Each server_rec can be in possibly multiple
@@ -383,6 +399,8 @@ static name_chain *new_name_chain(apr_pool_t *p,
     new->server = s;
     new->sar = sar;
     new->next = NULL;
+    new->pos = 0;
+    new->index = NULL;
     return new;
 }
 
@@ -562,6 +580,76 @@ static void add_name_vhost_config(apr_pool_t *p, server_rec *main_s,
 }
 
 /* compile the tables and such we need to do the run-time vhost lookups */
+static void index_name(apr_pool_t *p, apr_hash_t *h, const char *name,
+                       name_chain *nc)
+{
+    apr_array_header_t *arr;
+    char *key = apr_pstrdup(p, name);
+
+    ap_str_tolower(key);
+    arr = apr_hash_get(h, key, APR_HASH_KEY_STRING);
+    if (!arr) {
+        arr = apr_array_make(p, 1, sizeof(name_chain *));
+        apr_hash_set(h, key, APR_HASH_KEY_STRING, arr);
+    }
+    else if (APR_ARRAY_IDX(arr, arr->nelts - 1, name_chain *) == nc) {
+        return; /* same name twice in a vhost */
+    }
+    APR_ARRAY_PUSH(arr, name_chain *) = nc;
+}
+
+static void index_name_chain(apr_pool_t *p, name_chain *names)
+{
+    name_index *idx;
+    name_chain *nc;
+    int pos = 0;
+
+    if (!names) {
+        return;
+    }
+    idx = apr_palloc(p, sizeof(*idx));
+    idx->exact = apr_hash_make(p);
+    idx->domains = apr_hash_make(p);
+    idx->others = apr_array_make(p, 0, sizeof(name_chain *));
+
+    for (nc = names; nc; nc = nc->next) {
+        server_rec *s = nc->server;
+        int i, other = 0;
+
+        nc->pos = pos++;
+        if (s->server_hostname) {
+            index_name(p, idx->exact, s->server_hostname, nc);
+        }
+        if (s->names) {
+            char **name = (char **)s->names->elts;
+            for (i = 0; i < s->names->nelts; ++i) {
+                if (name[i]) {
+                    index_name(p, idx->exact, name[i], nc);
+                }
+            }
+        }
+        if (s->wild_names) {
+            char **name = (char **)s->wild_names->elts;
+            for (i = 0; i < s->wild_names->nelts; ++i) {
+                if (!name[i]) {
+                    continue;
+                }
+                if (name[i][0] == '*' && name[i][1] == '.'
+                    && !strpbrk(name[i] + 2, "*?")) {
+                    index_name(p, idx->domains, name[i] + 2, nc);
+                }
+                else {
+                    other = 1;
+                }
+            }
+        }
+        if (other) {
+            APR_ARRAY_PUSH(idx->others, name_chain *) = nc;
+        }
+    }
+    names->index = idx;
+}
+
 AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
 {
     server_addr_rec *sar;
@@ -677,6 +765,20 @@ AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
         }
     }
 
+    /* Index the names of the name-based vhosts for SNI lookups */
+    {
+        ipaddr_chain *ic;
+
+        for (i = 0; i < IPHASH_TABLE_SIZE; ++i) {
+            for (ic = iphash_table[i]; ic; ic = ic->next) {
+                index_name_chain(p, ic->names);
+            }
+        }
+        for (ic = default_list; ic; ic = ic->next) {
+            index_name_chain(p, ic->names);
+        }
+    }
+
 #ifdef IPHASH_STATISTICS
     dump_iphash_statistics(main_s);
 #endif
@@ -1261,6 +1363,82 @@ AP_DECLARE(int) ap_vhost_iterate_given_conn(conn_rec *conn,
     return rv;
 }
 
+/* The first entry of arr (before best) that can serve port */
+static APR_INLINE name_chain *first_name_match(apr_array_header_t *arr,
+                                               apr_port_t port,
+                                               name_chain *best)
+{
+    int i;
+
+    for (i = 0; arr && i < arr->nelts; ++i) {
+        name_chain *nc = APR_ARRAY_IDX(arr, i, name_chain *);
+        if (best && nc->pos >= best->pos) {
+            break;
+        }
+        if (nc->sar->host_port == 0 || nc->sar->host_port == port) {
+            return nc;
+        }
+    }
+    return best;
+}
+
+AP_DECLARE(server_rec *) ap_vhost_find_given_conn(conn_rec *conn,
+                                                  const char *host)
+{
+    name_chain *names = conn->vhost_lookup_data, *best;
+    name_index *idx;
+    apr_port_t port;
+    char key[256], *dot;
+    apr_size_t len;
+    int i;
+
+    if (!names) {
+        return matches_aliases(conn->base_server, host)
+               ? conn->base_server : NULL;
+    }
+
+    len = strlen(host);
+    idx = names->index;
+    if (!idx || len >= sizeof(key)) {
+        /* Not indexed (or overlong name), walk the chain */
+        port = conn->local_addr->port;
+        for (; names; names = names->next) {
+            if ((names->sar->host_port == 0 || names->sar->host_port == port)
+                && matches_aliases(names->server, host)) {
+                return names->server;
+            }
+        }
+        return NULL;
+    }
+
+    memcpy(key, host, len + 1);
+    ap_str_tolower(key);
+    port = conn->local_addr->port;
+
+    best = first_name_match(apr_hash_get(idx->exact, key, len), port, NULL);
+
+    /* "*.domain" aliases match any name ending with ".domain" */
+    for (dot = strchr(key, '.'); dot; dot = strchr(dot + 1, '.')) {
+        best = first_name_match(apr_hash_get(idx->domains, dot + 1,
+                                             len - (dot + 1 - key)),
+                                port, best);
+    }
+
+    for (i = 0; i < idx->others->nelts; ++i) {
+        name_chain *nc = APR_ARRAY_IDX(idx->others, i, name_chain *);
+        if (best && nc->pos >= best->pos) {
+            break;
+        }
+        if ((nc->sar->host_port == 0 || nc->sar->host_port == port)
+            && matches_aliases(nc->server, host)) {
+            best = nc;
+            break;
+        }
+    }
+
+    return best ? best->server : NULL;
+}
+
 /* Called for a new connection which has a known local_addr.  Note that the
  * new connection is assumed to have conn->server == main server.
  */
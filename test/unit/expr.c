@@ -0,0 +1,251 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../httpdunit.h"
+
+#include "httpd.h"
+#include "ap_expr.h"
+#include "../../server/util_expr_private.h"
+
+/*
+ * Test Fixture -- runs once per test
+ */
+
+static apr_pool_t *g_pool;
+static server_rec *g_server;
+static int g_calls;
+
+static void expr_setup(void)
+{
+    if (apr_pool_create(&g_pool, NULL) != APR_SUCCESS) {
+        exit(1);
+    }
+    g_server = apr_pcalloc(g_pool, sizeof(*g_server));
+    g_calls = 0;
+}
+
+static void expr_teardown(void)
+{
+    apr_pool_destroy(g_pool);
+}
+
+/*
+ * Lookups standing in for what depends on the request or the system:
+ * the variable %{TEST_VAR} and the functions file() and env(). Each
+ * call is counted, they must never be folded.
+ */
+
+static const char *test_var(ap_expr_eval_ctx_t *ctx, const void *data)
+{
+    g_calls++;
+    return "42";
+}
+
+static const char *test_func(ap_expr_eval_ctx_t *ctx, const void *data,
+                             const char *arg)
+{
+    g_calls++;
+    return apr_pstrcat(ctx->p, (const char *)data, ":", arg, NULL);
+}
+
+static int test_lookup(ap_expr_lookup_parms *parms)
+{
+    switch (parms->type) {
+    case AP_EXPR_FUNC_VAR:
+        if (strcmp(parms->name, "TEST_VAR") == 0) {
+            *parms->func = test_var;
+            *parms->data = parms->name;
+            return OK;
+        }
+        break;
+    case AP_EXPR_FUNC_STRING:
+        if (strcmp(parms->name, "file") == 0
+            || strcmp(parms->name, "env") == 0) {
+            *parms->func = test_func;
+            *parms->data = parms->name;
+            return OK;
+        }
+        break;
+    }
+    return DECLINED;
+}
+
+static ap_expr_info_t *test_parse(const char *expr, unsigned int flags)
+{
+    ap_expr_info_t *info = apr_pcalloc(g_pool, sizeof(*info));
+    const char *err;
+
+    info->flags = flags;
+    err = ap_expr_parse(g_pool, g_pool, info, expr, test_lookup);
+    ck_assert_msg(err == NULL, "%s: %s", expr, err);
+
+    return info;
+}
+
+static int test_exec(const ap_expr_info_t *info, const char **result)
+{
+    ap_expr_eval_ctx_t ctx;
+    ap_regmatch_t pmatch[AP_MAX_REG_MATCH];
+    const char *source = NULL, *err = NULL;
+    int rc;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.s = g_server;
+    ctx.p = g_pool;
+    ctx.err = &err;
+    ctx.info = info;
+    ctx.re_nmatch = AP_MAX_REG_MATCH;
+    ctx.re_pmatch = pmatch;
+    ctx.re_source = &source;
+    ctx.result_string = result;
+
+    rc = ap_expr_exec_ctx(&ctx);
+    ck_assert_msg(err == NULL, "%s", err);
+
+    return rc;
+}
+
+#define IS_CONST(e) ((e)->node_op == op_True \
+                     || (e)->node_op == op_False \
+                     || (e)->node_op == op_String)
+
+/*
+ * Boolean expressions
+ */
+
+struct expr_cond_case {
+    const char *expr;
+    unsigned int flags;
+    int expected;
+    int calls;      /* lookups done by one evaluation */
+    int folded;     /* folded to a constant at parse time */
+};
+
+static const struct expr_cond_case expr_cond_cases[] = {
+    /* string operators */
+    { "'a' . 'b' == 'ab'",              0, 1, 0, 1 },
+    { "'a' . 'b' . 'c' != 'abc'",       0, 0, 0, 1 },
+    { "'10' < '9'",                     0, 1, 0, 1 },
+    { "'10' >= '9'",                    0, 0, 0, 1 },
+    { "'' == ''",                       0, 1, 0, 1 },
+
+    /* integer operators */
+    { "10 -gt 9",                       0, 1, 0, 1 },
+    { "10 -lt 9",                       0, 0, 0, 1 },
+    { "010 -eq 10",                     0, 1, 0, 1 },
+    { "'1' . '0' -le 9",                0, 0, 0, 1 },
+
+    /* ssl_expr compares by length first, never folded */
+    { "'10' < '9'", AP_EXPR_FLAG_SSL_EXPR_COMPAT, 0, 0, 0 },
+
+    /* boolean operators */
+    { "!true",                          0, 0, 0, 1 },
+    { "!(1 -eq 2)",                     0, 1, 0, 1 },
+    { "true && 1 -eq 1",                0, 1, 0, 1 },
+    { "false || 'a' == 'b'",            0, 0, 0, 1 },
+    { "false && %{TEST_VAR} -eq 42",    0, 0, 0, 1 },
+    { "true || %{TEST_VAR} -eq 42",     0, 1, 0, 1 },
+
+    /* runtime operands are kept, and evaluated as often */
+    { "%{TEST_VAR} -eq 42",             0, 1, 1, 0 },
+    { "true && %{TEST_VAR} -eq 42",     0, 1, 1, 0 },
+    { "%{TEST_VAR} -eq 42 || true",     0, 1, 1, 0 },
+    { "%{TEST_VAR} -eq 0 && false",     0, 0, 1, 0 },
+    { "%{TEST_VAR} . 'a' . 'b' == '42ab'", 0, 1, 1, 0 },
+
+    /* functions are called at runtime, even with constant arguments */
+    { "file('/etc/' . 'hosts') == 'file:/etc/hosts'", 0, 1, 1, 0 },
+    { "env('A' . 'B') . 'c' == 'env:ABc'",            0, 1, 1, 0 },
+    { "%{env:HOME} == 'env:HOME'",                    0, 1, 1, 0 },
+    { "file('x') == file('x')",                       0, 1, 2, 0 },
+};
+
+static const size_t expr_cond_cases_len = sizeof(expr_cond_cases) /
+                                          sizeof(expr_cond_cases[0]);
+
+HTTPD_START_LOOP_TEST(folded_conditions_evaluate_as_unfolded, expr_cond_cases_len)
+{
+    const struct expr_cond_case *c = &expr_cond_cases[_i];
+    ap_expr_info_t *folded, *unfolded;
+
+    folded = test_parse(c->expr, c->flags);
+    unfolded = test_parse(c->expr, c->flags | AP_EXPR_FLAG_NO_FOLD);
+
+    ck_assert_int_eq(IS_CONST(folded->root_node), c->folded);
+    ck_assert_int_eq(IS_CONST(unfolded->root_node), 0);
+
+    g_calls = 0;
+    ck_assert_int_eq(test_exec(unfolded, NULL), c->expected);
+    ck_assert_int_eq(g_calls, c->calls);
+
+    g_calls = 0;
+    ck_assert_int_eq(test_exec(folded, NULL), c->expected);
+    ck_assert_int_eq(g_calls, c->calls);
+}
+END_TEST
+
+/*
+ * String expressions
+ */
+
+struct expr_string_case {
+    const char *expr;
+    const char *expected;
+    int calls;
+};
+
+static const struct expr_string_case expr_string_cases[] = {
+    { "a%{:'b' . 'c':}d",                 "abcd",          0 },
+    { "%{:'1' . '0' -gt 9:}",             "true",          0 },
+    { "x%{TEST_VAR}y",                    "x42y",          1 },
+    { "%{:%{TEST_VAR} . 'a' . 'b':}",     "42ab",          1 },
+    { "%{env:A}%{:file('b' . 'c'):}",     "env:Afile:bc",  2 },
+    { "%{:false && %{TEST_VAR} -eq 42:}", "false",         0 },
+};
+
+static const size_t expr_string_cases_len = sizeof(expr_string_cases) /
+                                            sizeof(expr_string_cases[0]);
+
+HTTPD_START_LOOP_TEST(folded_strings_evaluate_as_unfolded, expr_string_cases_len)
+{
+    const struct expr_string_case *c = &expr_string_cases[_i];
+    ap_expr_info_t *folded, *unfolded;
+    const char *result;
+
+    folded = test_parse(c->expr, AP_EXPR_FLAG_STRING_RESULT);
+    unfolded = test_parse(c->expr, AP_EXPR_FLAG_STRING_RESULT
+                                   | AP_EXPR_FLAG_NO_FOLD);
+
+    g_calls = 0;
+    result = NULL;
+    ck_assert_int_eq(test_exec(unfolded, &result), 1);
+    ck_assert_str_eq(result, c->expected);
+    ck_assert_int_eq(g_calls, c->calls);
+
+    g_calls = 0;
+    result = NULL;
+    ck_assert_int_eq(test_exec(folded, &result), 1);
+    ck_assert_str_eq(result, c->expected);
+    ck_assert_int_eq(g_calls, c->calls);
+}
+END_TEST
+
+/*
+ * Test Case Boilerplate
+ */
+HTTPD_BEGIN_TEST_CASE_WITH_FIXTURE(expr, expr_setup, expr_teardown)
+#include "test/unit/expr.tests"
+HTTPD_END_TEST_CASE
@@ -114,6 +114,48 @@ HTTPD_START_LOOP_TEST(check_escape_quotes, ap_test_escape_quotes_cases_len)
 END_TEST
 
 
+/*
+ * ap_escape_json()
+ */
+
+struct ap_escape_json_case {
+    const char *input;
+    const char *expected;
+};
+
+const struct ap_escape_json_case ap_test_escape_json_cases[] = {
+    { "", "" },
+    { "one", "one" },
+    { "o\"n\\e", "o\\\"n\\\\e" },
+    { "\b\f\n\r\t", "\\b\\f\\n\\r\\t" },
+    { "o\x01ne\x7f", "o\\u0001ne\x7f" },
+    { "h\xc3\xa9llo", "h\\u00e9llo" },                   /* 2 byte UTF-8 */
+    { "\xe2\x82\xac", "\\u20ac" },                       /* 3 byte UTF-8 */
+    { "\xf0\x9f\x98\x80", "\\ud83d\\ude00" },            /* surrogate pair */
+    { "bad\xff\xc3", "bad\\u00ff\\u00c3" },              /* invalid, truncated */
+    { "\xc0\xaf", "\\u00c0\\u00af" },                    /* overlong */
+    { "\xed\xa0\x80", "\\u00ed\\u00a0\\u0080" },         /* UTF-16 surrogate */
+};
+
+const size_t ap_test_escape_json_cases_len = sizeof(ap_test_escape_json_cases) /
+    sizeof(ap_test_escape_json_cases[0]);
+
+HTTPD_START_LOOP_TEST(check_escape_json, ap_test_escape_json_cases_len)
+{
+    const struct ap_escape_json_case *c = &ap_test_escape_json_cases[_i];
+    apr_size_t len;
+    char *result;
+
+    len = ap_escape_json(NULL, c->input);
+    ck_assert_uint_eq(len, strlen(c->expected));
+
+    result = apr_palloc(g_pool, len + 1);
+    ck_assert_uint_eq(ap_escape_json(result, c->input), len);
+    ck_assert_str_eq(result, c->expected);
+}
+END_TEST
+
+
 /*
  * Test Case Boilerplate
  */